@@ -0,0 +1,774 @@
+/* Copyright 2013 Oliver Katz
+ *
+ * This file is part of LibUNIXEscape.
+ *
+ * LibUNIXEscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LibUNIXEscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LibUNIXEscape.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file AttributeRope.h
+ *  \brief Contains AttributeRope class, an AttributeText for large buffers which are edited in place.
+ *  AttributeRope stores its text as a sequence of small AttributeText leaves kept in a balanced
+ *  tree (a treap ordered by position), so inserting, erasing and replacing text anywhere in the
+ *  buffer takes O(log n) instead of shifting everything after the edit. */
+
+#ifndef __LIB_UNIX_ESCAPE_ATTRIBUTE_ROPE_H
+#define __LIB_UNIX_ESCAPE_ATTRIBUTE_ROPE_H
+
+#include "Util.h"
+#include "AttributeText.h"
+
+/*! Namespace for all LibUNIXEscape classes/methods/global variables. */
+namespace unixescape
+{
+	/*! Rope of attribute-containing text. The template argument is whatever type you want the
+	 *  attributes to be, as for AttributeText.
+	 *  \warning Has the same interface as AttributeText for reading and editing, but characters are
+	 *  reached in O(log n), and c_str()/data() are replaced by toStdString(). */
+	template<typename T> class AttributeRope
+	{
+	protected:
+		typedef struct Node
+		{
+			AttributeText<T> leaf;
+			Node *left, *right;
+			size_t size;
+			unsigned int priority;
+
+			Node(const AttributeText<T> &l, unsigned int p) : leaf(l), left(NULL), right(NULL), size(0), priority(p) {}
+			Node(AttributeText<T> &&l, unsigned int p) : leaf(std::move(l)), left(NULL), right(NULL), size(0), priority(p) {}
+		} Node;
+
+		Node *root;
+		T *attrQueue;
+		unsigned int seed;
+
+		unsigned int random();
+		Node *makeLeaf(const AttributeText<T> &t);
+		static size_t sizeOf(Node *n);
+		static void update(Node *n);
+		static Node *merge(Node *a, Node *b);
+		static void split(Node *n, size_t pos, Node *&a, Node *&b);
+		static Node *copy(Node *n);
+		static void destroy(Node *n);
+		static Node *locate(Node *n, size_t &pos);
+		static bool insertSmall(Node *n, size_t pos, AttributeText<T> &t);
+		Node *build(const AttributeText<T> &t);
+		template<typename F> static void walk(Node *n, F &f);
+		template<typename F> static bool walkFrom(Node *n, size_t pos, size_t start, F &f);
+
+	public:
+		/*! Maximum size of the leaves created by edits. */
+		const static size_t leafSize = 1024;
+
+		const static size_t npos = string::npos;
+
+		/*! Read-only forward iterator over the characters of an AttributeRope. */
+		class const_iterator
+		{
+			AttributeRope *rope;
+			size_t pos, leafStart, leafEnd;
+			AttributeText<T> *leaf;
+
+			void load();
+
+		public:
+			typedef forward_iterator_tag iterator_category;
+			typedef char value_type;
+			typedef ptrdiff_t difference_type;
+			typedef const char *pointer;
+			typedef char reference;
+
+			/*! Constructor. */
+			const_iterator(AttributeRope *r = NULL, size_t p = 0) : rope(r), pos(p), leafStart(0), leafEnd(0), leaf(NULL) {}
+
+			char operator * ();
+			const_iterator &operator ++ ();
+			const_iterator operator ++ (int);
+			bool operator == (const const_iterator &i) const { return (pos == i.pos); }
+			bool operator != (const const_iterator &i) const { return (pos != i.pos); }
+		};
+
+		AttributeRope() : root(NULL), attrQueue(NULL), seed(2463534242u) {}
+		AttributeRope(const AttributeRope &r) : root(copy(r.root)), attrQueue(NULL), seed(r.seed) {}
+		AttributeRope(AttributeRope &&r) noexcept : root(r.root), attrQueue(NULL), seed(r.seed) { r.root = NULL; }
+		AttributeRope(const AttributeText<T> &t);
+		AttributeRope(const char *s);
+		~AttributeRope();
+		AttributeRope &operator = (const AttributeRope &r);
+		AttributeRope &operator = (AttributeRope &&r) noexcept;
+		AttributeRope &operator = (const char *s);
+		const_iterator begin();
+		const_iterator end();
+		const_iterator cbegin();
+		const_iterator cend();
+		size_t size();
+		size_t length();
+		void clear();
+		bool empty();
+		char &operator [] (size_t pos);
+		char &at(size_t pos);
+		char &back();
+		char &front();
+		AttributeRope &operator += (const AttributeText<T> &t);
+		AttributeRope &operator += (const char *s);
+		AttributeRope &operator += (char c);
+		AttributeRope &append(const AttributeText<T> &t);
+
+		/*! Appends \a t as one leaf, moving it into the rope instead of copying it. The leaf may be
+		 *  larger than leafSize; edits inside it cut it into smaller leaves. */
+		AttributeRope &append(AttributeText<T> &&t);
+
+		AttributeRope &append(const char *s);
+		AttributeRope &append(const char *s, size_t n);
+		AttributeRope &append(size_t n, char c);
+		AttributeRope &push_back(char c);
+		AttributeRope &push_back(char c, T a);
+		AttributeRope &insert(size_t pos, const AttributeText<T> &t);
+		AttributeRope &erase(size_t pos = 0, size_t len = npos);
+		AttributeRope &replace(size_t pos, size_t len, const AttributeText<T> &t);
+		void swap(AttributeRope &r);
+		void pop_back();
+		size_t find(const char *s, size_t pos = 0);
+		size_t find(char c, size_t pos = 0);
+		AttributeText<T> substr(size_t pos = 0, size_t len = npos);
+
+		// non-stl methods
+		/*! Converts AttributeRope to std::string (removes attributes). */
+		string toStdString();
+
+		/*! Converts AttributeRope to a single AttributeText. */
+		AttributeText<T> toAttributeText();
+
+		/*! There is an attribute queue (1-long max) that queues attributes for
+		 *  appending with the next appendature. This sets the queue to this attribute. */
+		void queueAttribute(T &a);
+
+		/*! Returns true if the character at a certain index has attributes. */
+		bool hasAttributes(size_t pos);
+
+		/*! Gets the attributes at a certain index (a default-constructed T if the character
+		 *  has none). */
+		T &getAttributes(size_t pos);
+
+		/*! Returns the number of leaves the text is stored in. */
+		size_t leafCount();
+
+		/*! Calls \a f with each leaf of the rope (an AttributeText<T> &) in order. */
+		template<typename F> void forEachLeaf(F f);
+	};
+
+	template<typename T> unsigned int AttributeRope<T>::random()
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	}
+
+	template<typename T> typename AttributeRope<T>::Node *AttributeRope<T>::makeLeaf(const AttributeText<T> &t)
+	{
+		Node *n = new Node(t, random());
+		update(n);
+		return n;
+	}
+
+	template<typename T> size_t AttributeRope<T>::sizeOf(Node *n)
+	{
+		return (n == NULL) ? 0 : n->size;
+	}
+
+	template<typename T> void AttributeRope<T>::update(Node *n)
+	{
+		n->size = sizeOf(n->left)+n->leaf.size()+sizeOf(n->right);
+	}
+
+	template<typename T> typename AttributeRope<T>::Node *AttributeRope<T>::merge(Node *a, Node *b)
+	{
+		if (a == NULL)
+			return b;
+		if (b == NULL)
+			return a;
+
+		if (a->priority > b->priority)
+		{
+			a->right = merge(a->right, b);
+			update(a);
+			return a;
+		}
+		else
+		{
+			b->left = merge(a, b->left);
+			update(b);
+			return b;
+		}
+	}
+
+	template<typename T> void AttributeRope<T>::split(Node *n, size_t pos, Node *&a, Node *&b)
+	{
+		// a gets the first pos characters, b the rest; a leaf straddling pos is cut in two
+		if (n == NULL)
+		{
+			a = NULL;
+			b = NULL;
+			return ;
+		}
+
+		size_t l = sizeOf(n->left);
+		if (pos <= l)
+		{
+			split(n->left, pos, a, n->left);
+			update(n);
+			b = n;
+		}
+		else if (pos >= l+n->leaf.size())
+		{
+			split(n->right, pos-l-n->leaf.size(), n->right, b);
+			update(n);
+			a = n;
+		}
+		else
+		{
+			Node *tail = new Node(n->leaf.substr(pos-l), n->priority);
+			n->leaf.erase(pos-l);
+			tail->right = n->right;
+			n->right = NULL;
+			update(tail);
+			update(n);
+			a = n;
+			b = tail;
+		}
+	}
+
+	template<typename T> typename AttributeRope<T>::Node *AttributeRope<T>::copy(Node *n)
+	{
+		if (n == NULL)
+			return NULL;
+
+		Node *c = new Node(n->leaf, n->priority);
+		c->left = copy(n->left);
+		c->right = copy(n->right);
+		c->size = n->size;
+		return c;
+	}
+
+	template<typename T> void AttributeRope<T>::destroy(Node *n)
+	{
+		if (n == NULL)
+			return ;
+
+		destroy(n->left);
+		destroy(n->right);
+		delete n;
+	}
+
+	template<typename T> typename AttributeRope<T>::Node *AttributeRope<T>::locate(Node *n, size_t &pos)
+	{
+		// finds the leaf containing pos, and makes pos relative to it
+		while (n != NULL)
+		{
+			size_t l = sizeOf(n->left);
+			if (pos < l)
+			{
+				n = n->left;
+			}
+			else if (pos < l+n->leaf.size())
+			{
+				pos -= l;
+				return n;
+			}
+			else
+			{
+				pos -= l+n->leaf.size();
+				n = n->right;
+			}
+		}
+
+		return NULL;
+	}
+
+	template<typename T> bool AttributeRope<T>::insertSmall(Node *n, size_t pos, AttributeText<T> &t)
+	{
+		if (n == NULL)
+			return false;
+
+		size_t l = sizeOf(n->left);
+		bool done;
+		if (pos < l)
+		{
+			done = insertSmall(n->left, pos, t);
+		}
+		else if (pos <= l+n->leaf.size())
+		{
+			if (n->leaf.size()+t.size() > leafSize)
+				return false;
+			n->leaf.insert(pos-l, t);
+			done = true;
+		}
+		else
+		{
+			done = insertSmall(n->right, pos-l-n->leaf.size(), t);
+		}
+
+		if (done)
+			n->size += t.size();
+		return done;
+	}
+
+	template<typename T> typename AttributeRope<T>::Node *AttributeRope<T>::build(const AttributeText<T> &t)
+	{
+		AttributeText<T> &src = const_cast<AttributeText<T> &>(t);
+		Node *rtn = NULL;
+
+		for (size_t i = 0; i < src.size(); i += leafSize)
+			rtn = merge(rtn, makeLeaf(src.substr(i, leafSize)));
+
+		return rtn;
+	}
+
+	template<typename T> template<typename F> void AttributeRope<T>::walk(Node *n, F &f)
+	{
+		if (n == NULL)
+			return ;
+
+		walk(n->left, f);
+		f(n->leaf);
+		walk(n->right, f);
+	}
+
+	template<typename T> template<typename F> bool AttributeRope<T>::walkFrom(Node *n, size_t pos, size_t start, F &f)
+	{
+		// descends to the leaf containing pos by the subtree sizes, then passes it and every later
+		// leaf to f along with its start until f returns true, and returns whether it did
+		if (n == NULL)
+			return false;
+
+		size_t mid = start+sizeOf(n->left);
+		if (pos < mid && walkFrom(n->left, pos, start, f))
+			return true;
+		if (pos < mid+n->leaf.size() && f(n->leaf, mid))
+			return true;
+		return walkFrom(n->right, pos, mid+n->leaf.size(), f);
+	}
+
+	template<typename T> void AttributeRope<T>::const_iterator::load()
+	{
+		size_t rel = pos;
+		Node *n = locate(rope->root, rel);
+		leaf = &n->leaf;
+		leafStart = pos-rel;
+		leafEnd = leafStart+leaf->size();
+	}
+
+	template<typename T> char AttributeRope<T>::const_iterator::operator * ()
+	{
+		if (leaf == NULL || pos < leafStart || pos >= leafEnd)
+			load();
+		return leaf->chars()[pos-leafStart];
+	}
+
+	template<typename T> typename AttributeRope<T>::const_iterator &AttributeRope<T>::const_iterator::operator ++ ()
+	{
+		pos++;
+		return *this;
+	}
+
+	template<typename T> typename AttributeRope<T>::const_iterator AttributeRope<T>::const_iterator::operator ++ (int)
+	{
+		const_iterator tmp = *this;
+		pos++;
+		return tmp;
+	}
+
+	template<typename T> AttributeRope<T>::AttributeRope(const AttributeText<T> &t) : root(NULL), attrQueue(NULL), seed(2463534242u)
+	{
+		root = build(t);
+	}
+
+	template<typename T> AttributeRope<T>::AttributeRope(const char *s) : root(NULL), attrQueue(NULL), seed(2463534242u)
+	{
+		root = build(AttributeText<T>(s));
+	}
+
+	template<typename T> AttributeRope<T>::~AttributeRope()
+	{
+		destroy(root);
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::operator = (const AttributeRope<T> &r)
+	{
+		if (&r != this)
+		{
+			destroy(root);
+			root = copy(r.root);
+		}
+		return *this;
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::operator = (AttributeRope<T> &&r) noexcept
+	{
+		if (&r != this)
+		{
+			destroy(root);
+			root = r.root;
+			r.root = NULL;
+		}
+		return *this;
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::operator = (const char *s)
+	{
+		clear();
+		return append(s);
+	}
+
+	template<typename T> typename AttributeRope<T>::const_iterator AttributeRope<T>::begin()
+	{
+		return const_iterator(this, 0);
+	}
+
+	template<typename T> typename AttributeRope<T>::const_iterator AttributeRope<T>::end()
+	{
+		return const_iterator(this, size());
+	}
+
+	template<typename T> typename AttributeRope<T>::const_iterator AttributeRope<T>::cbegin()
+	{
+		return begin();
+	}
+
+	template<typename T> typename AttributeRope<T>::const_iterator AttributeRope<T>::cend()
+	{
+		return end();
+	}
+
+	template<typename T> size_t AttributeRope<T>::size()
+	{
+		return sizeOf(root);
+	}
+
+	template<typename T> size_t AttributeRope<T>::length()
+	{
+		return sizeOf(root);
+	}
+
+	template<typename T> void AttributeRope<T>::clear()
+	{
+		destroy(root);
+		root = NULL;
+	}
+
+	template<typename T> bool AttributeRope<T>::empty()
+	{
+		return (root == NULL);
+	}
+
+	template<typename T> char &AttributeRope<T>::operator [] (size_t pos)
+	{
+		Node *n = locate(root, pos);
+		return n->leaf[pos];
+	}
+
+	template<typename T> char &AttributeRope<T>::at(size_t pos)
+	{
+		if (pos >= size())
+			throw out_of_range("AttributeRope::at");
+		return (*this)[pos];
+	}
+
+	template<typename T> char &AttributeRope<T>::back()
+	{
+		return (*this)[size()-1];
+	}
+
+	template<typename T> char &AttributeRope<T>::front()
+	{
+		return (*this)[0];
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::operator += (const AttributeText<T> &t)
+	{
+		return append(t);
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::operator += (const char *s)
+	{
+		return append(s);
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::operator += (char c)
+	{
+		return push_back(c);
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::append(const AttributeText<T> &t)
+	{
+		return insert(size(), t);
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::append(AttributeText<T> &&t)
+	{
+		if (t.empty() || attrQueue != NULL)
+			return insert(size(), t);
+
+		Node *n = new Node(std::move(t), random());
+		update(n);
+		root = merge(root, n);
+		return *this;
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::append(const char *s)
+	{
+		return insert(size(), AttributeText<T>(s));
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::append(const char *s, size_t n)
+	{
+		return insert(size(), AttributeText<T>(s, n));
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::append(size_t n, char c)
+	{
+		return insert(size(), AttributeText<T>(n, c));
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::push_back(char c)
+	{
+		if (attrQueue != NULL)
+		{
+			push_back(c, *attrQueue);
+			attrQueue = NULL;
+			return *this;
+		}
+
+		return insert(size(), AttributeText<T>(1, c));
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::push_back(char c, T a)
+	{
+		return insert(size(), AttributeText<T>(1, c, a));
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::insert(size_t pos, const AttributeText<T> &t)
+	{
+		AttributeText<T> &src = const_cast<AttributeText<T> &>(t);
+		if (src.empty())
+			return *this;
+
+		if (attrQueue != NULL)
+		{
+			AttributeText<T> tmp;
+			tmp.queueAttribute(*attrQueue);
+			tmp.append(src);
+			if (!src.hasAttributes(0))
+				attrQueue = NULL;
+			return insert(pos, tmp);
+		}
+
+		// small inserts go into an existing leaf if it has room
+		if (src.size() < leafSize && insertSmall(root, pos, src))
+			return *this;
+
+		Node *a, *b;
+		split(root, pos, a, b);
+		root = merge(merge(a, build(src)), b);
+		return *this;
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::erase(size_t pos, size_t len)
+	{
+		size_t n = size();
+		if (pos > n)
+			pos = n;
+		if (len > n-pos)
+			len = n-pos;
+
+		Node *a, *b, *c;
+		split(root, pos, a, b);
+		split(b, len, b, c);
+		destroy(b);
+		root = merge(a, c);
+		return *this;
+	}
+
+	template<typename T> AttributeRope<T> &AttributeRope<T>::replace(size_t pos, size_t len, const AttributeText<T> &t)
+	{
+		erase(pos, len);
+		return insert(pos, t);
+	}
+
+	template<typename T> void AttributeRope<T>::swap(AttributeRope<T> &r)
+	{
+		std::swap(root, r.root);
+		std::swap(seed, r.seed);
+	}
+
+	template<typename T> void AttributeRope<T>::pop_back()
+	{
+		erase(size()-1, 1);
+	}
+
+	template<typename T> size_t AttributeRope<T>::find(const char *s, size_t pos)
+	{
+		size_t m = strlen(s);
+		if (m == 0)
+			return (pos <= size()) ? pos : npos;
+
+		// the last m-1 characters of the previous leaves are kept so matches across leaves are found
+		struct Search
+		{
+			string_view needle;
+			size_t pos, windowStart, rtn;
+			string window;
+
+			bool operator () (AttributeText<T> &leaf, size_t start)
+			{
+				size_t from = (pos > start) ? pos-start : 0;
+				if (window.empty())
+					windowStart = start+from;
+				window.append(leaf.chars().substr(from));
+
+				size_t i = scanFind(window.data(), window.size(), needle.data(), needle.size());
+				if (i != npos)
+				{
+					rtn = windowStart+i;
+					return true;
+				}
+				if (window.size() >= needle.size())
+				{
+					windowStart += window.size()-(needle.size()-1);
+					window.erase(0, window.size()-(needle.size()-1));
+				}
+				return false;
+			}
+		} f = {string_view(s, m), pos, pos, npos, string()};
+
+		walkFrom(root, pos, 0, f);
+		return f.rtn;
+	}
+
+	template<typename T> size_t AttributeRope<T>::find(char c, size_t pos)
+	{
+		struct Search
+		{
+			char c;
+			size_t pos, rtn;
+
+			bool operator () (AttributeText<T> &leaf, size_t start)
+			{
+				size_t i = leaf.chars().find(c, (pos > start) ? pos-start : 0);
+				if (i != npos)
+					rtn = start+i;
+				return (i != npos);
+			}
+		} f = {c, pos, npos};
+
+		walkFrom(root, pos, 0, f);
+		return f.rtn;
+	}
+
+	template<typename T> AttributeText<T> AttributeRope<T>::substr(size_t pos, size_t len)
+	{
+		size_t n = size();
+		if (pos > n)
+			pos = n;
+		if (len > n-pos)
+			len = n-pos;
+
+		AttributeText<T> rtn;
+		size_t start = 0;
+		struct Collect
+		{
+			size_t pos, len, &start;
+			AttributeText<T> &rtn;
+
+			void operator () (AttributeText<T> &leaf)
+			{
+				size_t end = start+leaf.size();
+				if (end > pos && start < pos+len)
+				{
+					size_t from = (pos > start) ? pos-start : 0;
+					size_t to = (pos+len < end) ? pos+len-start : leaf.size();
+					rtn.append(leaf.substr(from, to-from));
+				}
+				start = end;
+			}
+		} f = {pos, len, start, rtn};
+
+		walk(root, f);
+		return rtn;
+	}
+
+	template<typename T> string AttributeRope<T>::toStdString()
+	{
+		string rtn;
+		struct Collect
+		{
+			string &rtn;
+
+			void operator () (AttributeText<T> &leaf)
+			{
+				rtn.append(leaf.view());
+			}
+		} f = {rtn};
+
+		walk(root, f);
+		return rtn;
+	}
+
+	template<typename T> AttributeText<T> AttributeRope<T>::toAttributeText()
+	{
+		return substr();
+	}
+
+	template<typename T> void AttributeRope<T>::queueAttribute(T &a)
+	{
+		attrQueue = &a;
+	}
+
+	template<typename T> bool AttributeRope<T>::hasAttributes(size_t pos)
+	{
+		Node *n = locate(root, pos);
+		return n->leaf.hasAttributes(pos);
+	}
+
+	template<typename T> T &AttributeRope<T>::getAttributes(size_t pos)
+	{
+		Node *n = locate(root, pos);
+		return n->leaf.getAttributes(pos);
+	}
+
+	template<typename T> size_t AttributeRope<T>::leafCount()
+	{
+		size_t count = 0;
+		struct Count
+		{
+			size_t &count;
+
+			void operator () (AttributeText<T> &leaf)
+			{
+				count++;
+			}
+		} f = {count};
+
+		walk(root, f);
+		return count;
+	}
+
+	template<typename T> template<typename F> void AttributeRope<T>::forEachLeaf(F f)
+	{
+		walk(root, f);
+	}
+}
+
+#endif
@@ -28,17 +28,34 @@
 #define __LIB_UNIX_ESCAPE_ATTRIBUTE_TEXT_H
 
 #include "Util.h"
+#include "Scan.h"
+#include "Utf8.h"
+#include "Counters.h"
 
 /*! Namespace for all LibUNIXEscape classes/methods/global variables. */
 namespace unixescape
 {
 	/*! Class for attribute-containing text. The template argument is whatever type you want the
 	 *  attributes to be.
+	 *  The characters are stored in one contiguous buffer, and the attributes in a table of
+	 *  (position, attribute) spans sorted by position, so plain characters cost one byte each and
+	 *  only the characters which actually have attributes pay for a T. A second buffer holding just
+	 *  the plain characters (every character but the 0 placeholders) is kept up to date as text is
+	 *  appended, so c_str(), data() and view() don't copy; it is rebuilt lazily after edits in the
+	 *  middle of the text, and after any access through the non-const operator [], at(), back(),
+	 *  front() or iterators, since the reference they return may be written to. Such an access
+	 *  invalidates the pointers returned by c_str(), data() and view(); reading through a const
+	 *  AttributeText (or cbegin(), chars()) leaves them valid, and doesn't cost a rebuild.
+	 *  All three buffers allocate from a std::pmr::memory_resource, the default one unless another
+	 *  is given to the constructor, so a batch of texts can be built in an arena and freed at once.
+	 *  Like std::pmr containers, copies (including substr()) allocate from the default resource,
+	 *  moves keep the resource, and assignment keeps the resource of the destination.
+	 *  When Counters are enabled, the growth of the character buffer is counted.
 	 *  \warning Is mostly compatible with STL strings - most methods, members, and subtypes of std::string work for AttributeText objects. */
 	template<typename T> class AttributeText
 	{
 	public:
-		/*! A character type that can have attributes. */
+		/*! A character paired with its attributes, as returned by charAt(). */
 		typedef struct Char
 		{
 			/*! The character value.
@@ -89,7 +106,7 @@ namespace unixescape
 			 *  \warning It is recomended to use isAttribute() instead. */
 			bool isAttr;
 
-			/*! A pointer to the attributes. 
+			/*! A pointer to the attributes.
 			 *  \warning It is recomended to use getAttribute() instead. */
 			T *attr;
 
@@ -115,49 +132,152 @@ namespace unixescape
 		} Segment;
 
 	protected:
-		vector<Char> content;
+		typedef struct Span
+		{
+			size_t pos;
+			T attr;
+
+			Span(size_t p, const T &a) : pos(p), attr(a) {}
+			Span(size_t p, T &&a) : pos(p), attr(std::move(a)) {}
+		} Span;
+
+	public:
+		/*! Non-owning segment of text or attributes produced by segments(). The string and attribute
+		 *  point into the AttributeText, and stay valid until it is modified. */
+		typedef struct SegmentView
+		{
+			/*! A pointer to the attributes, or NULL if the segment is text.
+			 *  \warning It is recomended to use getAttribute() instead. */
+			const T *attr;
+
+			/*! The string value (empty if the segment is an attribute).
+			 *  \warning It is recomended to use getString() instead. */
+			string_view str;
+
+			/*! Returns true if the segment is an attribute. */
+			bool isAttribute() const;
+
+			/*! Returns the attribute. */
+			const T &getAttribute() const;
+
+			/*! Returns the string. */
+			string_view getString() const;
+		} SegmentView;
+
+		/*! Forward iterator over the segments of an AttributeText, in the same order as splitByAttributes()
+		 *  returns them. */
+		class SegmentIterator
+		{
+			const pmr::string *text;
+			const pmr::vector<Span> *spans;
+			size_t pos, span, next;
+			int step;
+			SegmentView seg;
+
+			void load();
+
+		public:
+			typedef forward_iterator_tag iterator_category;
+			typedef SegmentView value_type;
+			typedef ptrdiff_t difference_type;
+			typedef const SegmentView *pointer;
+			typedef const SegmentView &reference;
+
+			/*! Constructor (end iterator). */
+			SegmentIterator() : text(NULL), spans(NULL), pos(0), span(0), next(0), step(3) {}
+
+			/*! Constructor. */
+			SegmentIterator(const pmr::string &t, const pmr::vector<Span> &s) : text(&t), spans(&s), pos(0), span(0), next(0), step(0) { load(); }
+
+			reference operator * () const { return seg; }
+			pointer operator -> () const { return &seg; }
+			SegmentIterator &operator ++ ();
+			SegmentIterator operator ++ (int);
+			bool operator == (const SegmentIterator &i) const;
+			bool operator != (const SegmentIterator &i) const { return !(*this == i); }
+		};
+
+		/*! Range of segments returned by segments(), for use with range-based for loops. */
+		typedef struct SegmentRange
+		{
+			SegmentIterator first;
+
+			SegmentIterator begin() const { return first; }
+			SegmentIterator end() const { return SegmentIterator(); }
+		} SegmentRange;
+
+	protected:
+
+		pmr::string text;
+		pmr::vector<Span> spans;
 		T *attrQueue;
+		pmr::string plain;
+		bool plainDirty;
 
-		void applyQueue(T **q);
+		typename pmr::vector<Span>::iterator spanAt(size_t pos);
+		void shiftSpans(typename pmr::vector<Span>::iterator from, size_t by, bool forward);
+		void applyQueue(size_t pos);
+		void appendPlain(const char *s, size_t n);
+		void reserveSpans(size_t n);
+		void touch();
 
 	public:
 		// C++ STL::string compatibility
-		typedef typename vector<Char>::iterator iterator;
-		typedef typename vector<Char>::const_iterator const_iterator;
-		typedef typename vector<Char>::reverse_iterator reverse_iterator;
-		typedef typename vector<Char>::const_reverse_iterator const_reverse_iterator;
+		typedef typename pmr::string::iterator iterator;
+		typedef typename pmr::string::const_iterator const_iterator;
+		typedef typename pmr::string::reverse_iterator reverse_iterator;
+		typedef typename pmr::string::const_reverse_iterator const_reverse_iterator;
 
 		const static size_t npos = string::npos;
 
-		AttributeText() : attrQueue(NULL) {}
-		AttributeText(const AttributeText &t) : content(t.content), attrQueue(NULL) {}
+		AttributeText() : attrQueue(NULL), plainDirty(false) {}
+		AttributeText(const AttributeText &t) : text(t.text), spans(t.spans), attrQueue(NULL), plain(t.plain), plainDirty(t.plainDirty) {}
+
+		/*! Constructs an empty AttributeText which allocates all of its memory from \a mr. */
+		explicit AttributeText(pmr::memory_resource *mr) : text(mr), spans(mr), attrQueue(NULL), plain(mr), plainDirty(false) {}
+
+		/*! Copies \a t into memory allocated from \a mr. */
+		AttributeText(const AttributeText &t, pmr::memory_resource *mr) : text(t.text, mr), spans(t.spans, mr), attrQueue(NULL), plain(t.plain, mr), plainDirty(t.plainDirty) {}
+		AttributeText(AttributeText &&t) noexcept : text(std::move(t.text)), spans(std::move(t.spans)), attrQueue(NULL), plain(std::move(t.plain)), plainDirty(t.plainDirty) {}
 		AttributeText(const char *s);
 		AttributeText(const char *s, size_t n);
 		AttributeText(size_t n, char c);
 		AttributeText(size_t n, char c, T a);
 		AttributeText &operator = (const AttributeText &t);
+		AttributeText &operator = (AttributeText &&t) noexcept;
 		AttributeText &operator = (const char *s);
 		AttributeText &operator = (char c);
 		iterator begin();
 		iterator end();
-		const_iterator cbegin();
-		const_iterator cend();
+		const_iterator begin() const;
+		const_iterator end() const;
+		const_iterator cbegin() const;
+		const_iterator cend() const;
 		reverse_iterator rbegin();
 		reverse_iterator rend();
-		const_reverse_iterator crbegin();
-		const_reverse_iterator crend();
-		size_t size();
-		size_t length();
+		const_reverse_iterator rbegin() const;
+		const_reverse_iterator rend() const;
+		const_reverse_iterator crbegin() const;
+		const_reverse_iterator crend() const;
+		size_t size() const;
+		size_t length() const;
+		void reserve(size_t n);
 		void clear();
-		bool empty();
+		bool empty() const;
 		char &operator [] (size_t pos);
+		const char &operator [] (size_t pos) const;
 		char &at(size_t pos);
+		const char &at(size_t pos) const;
 		char &back();
+		const char &back() const;
 		char &front();
+		const char &front() const;
 		AttributeText &operator += (const AttributeText &t);
+		AttributeText &operator += (AttributeText &&t);
 		AttributeText &operator += (const char *s);
 		AttributeText &operator += (char c);
 		AttributeText &append(const AttributeText &t);
+		AttributeText &append(AttributeText &&t);
 		AttributeText &append(const char *s);
 		AttributeText &append(const char *s, size_t n);
 		AttributeText &append(size_t n, char c);
@@ -175,9 +295,11 @@ namespace unixescape
 		size_t find(const AttributeText &t, size_t pos = 0);
 		size_t find(const char *s, size_t pos = 0);
 		size_t find(char c, size_t pos = 0);
-		size_t rfind(const AttributeText &t, size_t pos = 0);
-		size_t rfind(const char *s, size_t pos = 0);
-		size_t rfind(char c, size_t pos = 0);
+		size_t find(const Searcher &s, size_t pos = 0);
+		size_t rfind(const AttributeText &t, size_t pos = npos);
+		size_t rfind(const char *s, size_t pos = npos);
+		size_t rfind(char c, size_t pos = npos);
+		size_t rfind(const Searcher &s, size_t pos = npos);
 		AttributeText substr(size_t pos = 0, size_t len = npos);
 		int compare(const AttributeText &t);
 		int compare(size_t pos, size_t len, const AttributeText &t);
@@ -185,9 +307,20 @@ namespace unixescape
 		int compare(size_t pos, size_t len, const char *s);
 
 		// non-stl methods
+		/*! Returns the memory resource the text allocates from. */
+		pmr::memory_resource *getResource();
+
 		/*! Converts AttributeText to std::string (removes attributes). */
 		string toStdString();
 
+		/*! Returns a view of the plain characters (without attributes or 0 placeholders), which
+		 *  stays valid until the AttributeText is modified. */
+		string_view view();
+
+		/*! Returns a view of all the characters, including the 0 placeholders, so that index i of the
+		 *  view is character i. It stays valid until the AttributeText is modified. */
+		string_view chars() const;
+
 		/*! Converts AttributeText to std::string for debugging purposes (keeps attributes). */
 		string toDebugString();
 
@@ -195,12 +328,35 @@ namespace unixescape
 		 *  appending with the next appendature. This sets the queue to this attribute. */
 		void queueAttribute(T &a);
 
-		/*! Gets the attributes at a certain index. */
+		/*! Returns true if the character at a certain index has attributes. */
+		bool hasAttributes(size_t pos);
+
+		/*! Gets the attributes at a certain index (a default-constructed T if the character
+		 *  has none). */
 		T &getAttributes(size_t pos);
 
+		/*! Gets the character at a certain index together with its attributes. */
+		Char charAt(size_t pos);
+
+		/*! Returns the number of characters which have attributes. */
+		size_t attributeCount();
+
 		/*! Splits the AttributeText into a vector of Segment instances, which can be either plain text strings
 		 *  or individual attributes. */
 		vector<Segment> splitByAttributes();
+
+		/*! Returns the same segments as splitByAttributes(), but lazily and without copying: each SegmentView
+		 *  refers to the text and attributes stored in the AttributeText. */
+		SegmentRange segments();
+
+		/*! Returns the code points of the UTF-8 encoded text, with their positions in chars(). The 0
+		 *  placeholders of attributes are skipped, and ill-formed bytes decode as replacementCharacter. */
+		CodePointRange codePoints();
+
+		/*! Returns the grapheme clusters (user-perceived characters) of the UTF-8 encoded text, with
+		 *  their positions in chars(). A cluster continues across attributes, such as a combining mark
+		 *  written after a change of color. */
+		GraphemeRange graphemes();
 	};
 
 	template<typename T> char &AttributeText<T>::Char::getChar()
@@ -220,7 +376,7 @@ namespace unixescape
 
 	template<typename T> typename AttributeText<T>::Char &AttributeText<T>::Char::operator = (Char c)
 	{
-		c = c.c;
+		this->c = c.c;
 		useAttr = c.useAttr;
 		attr = c.attr;
 		return *this;
@@ -236,12 +392,12 @@ namespace unixescape
 
 	template<typename T> bool AttributeText<T>::Char::operator == (Char &c)
 	{
-		return (this->c != c.c);
+		return (this->c == c.c);
 	}
 
 	template<typename T> bool AttributeText<T>::Char::operator == (char c)
 	{
-		return (this->c != c);
+		return (this->c == c);
 	}
 
 	template<typename T> bool AttributeText<T>::Segment::isAttribute()
@@ -259,215 +415,493 @@ namespace unixescape
 		return str;
 	}
 
-	template<typename T> void AttributeText<T>::applyQueue(T **a)
+	template<typename T> bool AttributeText<T>::SegmentView::isAttribute() const
 	{
-		if (a == NULL)
-			return ;
+		return (attr != NULL);
+	}
+
+	template<typename T> const T &AttributeText<T>::SegmentView::getAttribute() const
+	{
+		return *attr;
+	}
+
+	template<typename T> string_view AttributeText<T>::SegmentView::getString() const
+	{
+		return str;
+	}
+
+	template<typename T> void AttributeText<T>::SegmentIterator::load()
+	{
+		// step 0: text before the next attribute, 1: the attribute, 2: its character, 3: end
+		if (step == 0)
+		{
+			next = (span < spans->size()) ? (*spans)[span].pos : text->size();
+			if (next > pos)
+			{
+				seg.attr = NULL;
+				seg.str = string_view(text->data()+pos, next-pos);
+				return ;
+			}
+			step = 1;
+		}
+
+		if (step == 1)
+		{
+			if (span < spans->size())
+			{
+				seg.attr = &(*spans)[span].attr;
+				seg.str = string_view();
+			}
+			else
+			{
+				step = 3;
+			}
+		}
+		else if (step == 2)
+		{
+			seg.attr = NULL;
+			seg.str = string_view(text->data()+(*spans)[span].pos, 1);
+		}
+	}
+
+	template<typename T> typename AttributeText<T>::SegmentIterator &AttributeText<T>::SegmentIterator::operator ++ ()
+	{
+		if (step == 0)
+		{
+			pos = next;
+			step = 1;
+		}
+		else if (step == 1)
+		{
+			step = 2;
+		}
+		else if (step == 2)
+		{
+			pos = (*spans)[span].pos+1;
+			span++;
+			step = 0;
+		}
+
+		load();
+		return *this;
+	}
+
+	template<typename T> typename AttributeText<T>::SegmentIterator AttributeText<T>::SegmentIterator::operator ++ (int)
+	{
+		SegmentIterator tmp = *this;
+		++*this;
+		return tmp;
+	}
 
-		if (*a == NULL)
+	template<typename T> bool AttributeText<T>::SegmentIterator::operator == (const SegmentIterator &i) const
+	{
+		if (step == 3 || i.step == 3)
+			return (step == i.step);
+		return (pos == i.pos && span == i.span && step == i.step);
+	}
+
+	template<typename T> typename pmr::vector<typename AttributeText<T>::Span>::iterator AttributeText<T>::spanAt(size_t pos)
+	{
+		// first span at or after pos
+		size_t lo = 0, hi = spans.size();
+		while (lo < hi)
+		{
+			size_t mid = (lo+hi)/2;
+			if (spans[mid].pos < pos)
+				lo = mid+1;
+			else
+				hi = mid;
+		}
+		return spans.begin()+lo;
+	}
+
+	template<typename T> void AttributeText<T>::shiftSpans(typename pmr::vector<Span>::iterator from, size_t by, bool forward)
+	{
+		for (; from != spans.end(); from++)
+		{
+			if (forward)
+				from->pos += by;
+			else
+				from->pos -= by;
+		}
+	}
+
+	template<typename T> void AttributeText<T>::applyQueue(size_t pos)
+	{
+		if (attrQueue == NULL)
 			return ;
 
-		if (content.empty())
+		if (pos >= text.size())
 			return ;
 
-		if (content[0].hasAttributes())
+		typename pmr::vector<Span>::iterator i = spanAt(pos);
+		if (i != spans.end() && i->pos == pos)
 			return ;
 
-		cout << "applying queued attribute to '" << toStdString() << "'...\n";
-		content[0].attr = **a;
-		content[0].useAttr = true;
-		*a = NULL;
+		UE_TRACE("applying queued attribute at " << pos);
+		spans.insert(i, Span(pos, *attrQueue));
+		attrQueue = NULL;
 	}
 
-	template<typename T> AttributeText<T>::AttributeText(const char *s)
+	template<typename T> void AttributeText<T>::appendPlain(const char *s, size_t n)
 	{
-		attrQueue = NULL;
+		if (plainDirty)
+			return ;
 
-		while(*s != 0)
+		const char *end = s+n;
+		while (s != end)
 		{
-			content.push_back(Char(*s));
-			s++;
+			const char *z = (const char *)memchr(s, 0, end-s);
+			if (z == NULL)
+				z = end;
+			plain.append(s, z-s);
+			s = (z == end) ? end : z+1;
 		}
 	}
 
-	template<typename T> AttributeText<T>::AttributeText(const char *s, size_t n)
+	template<typename T> void AttributeText<T>::reserveSpans(size_t n)
 	{
-		attrQueue = NULL;
-		
-		for (int i = 0; i < n; i++)
-			content.push_back(Char(s[i]));
+		// grow geometrically, so that repeated appends stay amortized constant
+		if (spans.capacity() < n)
+			spans.reserve(max(n, spans.capacity()*2));
 	}
 
-	template<typename T> AttributeText<T>::AttributeText(size_t n, char c)
+	template<typename T> void AttributeText<T>::touch()
 	{
-		attrQueue = NULL;
-		
-		for (int i = 0; i < n; i++)
-			content.push_back(Char(c));
+		plainDirty = true;
+		plain.clear();
+	}
+
+	template<typename T> AttributeText<T>::AttributeText(const char *s) : text(s), attrQueue(NULL), plainDirty(false)
+	{
+		appendPlain(text.data(), text.size());
+	}
+
+	template<typename T> AttributeText<T>::AttributeText(const char *s, size_t n) : text(s, n), attrQueue(NULL), plainDirty(false)
+	{
+		appendPlain(text.data(), text.size());
+	}
+
+	template<typename T> AttributeText<T>::AttributeText(size_t n, char c) : text(n, c), attrQueue(NULL), plainDirty(false)
+	{
+		appendPlain(text.data(), text.size());
+	}
+
+	template<typename T> AttributeText<T>::AttributeText(size_t n, char c, T a) : text(n, c), attrQueue(NULL), plainDirty(false)
+	{
+		appendPlain(text.data(), text.size());
+		spans.reserve(n);
+		for (size_t i = 0; i < n; i++)
+			spans.push_back(Span(i, a));
 	}
 
 	template<typename T> AttributeText<T> &AttributeText<T>::operator = (const AttributeText<T> &t)
 	{
-		content = t.content;
+		text = t.text;
+		spans = t.spans;
+		plain = t.plain;
+		plainDirty = t.plainDirty;
+		return *this;
+	}
+
+	template<typename T> AttributeText<T> &AttributeText<T>::operator = (AttributeText<T> &&t) noexcept
+	{
+		if (&t == this)
+			return *this;
+
+		text = std::move(t.text);
+		spans = std::move(t.spans);
+		plain = std::move(t.plain);
+		plainDirty = t.plainDirty;
+		t.clear();
+		return *this;
 	}
 
 	template<typename T> AttributeText<T> &AttributeText<T>::operator = (const char *s)
 	{
-		content = AttributeText<T>(s).content;
+		clear();
+		return append(s);
 	}
 
 	template<typename T> AttributeText<T> &AttributeText<T>::operator = (char c)
 	{
-		content = AttributeText<T>(1, c).content;
+		clear();
+		return append(1, c);
 	}
 
 	template<typename T> typename AttributeText<T>::iterator AttributeText<T>::begin()
 	{
-		return content.begin();
+		touch();
+		return text.begin();
 	}
 
 	template<typename T> typename AttributeText<T>::reverse_iterator AttributeText<T>::rbegin()
 	{
-		return content.rbegin();
+		touch();
+		return text.rbegin();
+	}
+
+	template<typename T> typename AttributeText<T>::const_iterator AttributeText<T>::begin() const
+	{
+		return text.cbegin();
 	}
 
-	template<typename T> typename AttributeText<T>::const_iterator AttributeText<T>::cbegin()
+	template<typename T> typename AttributeText<T>::const_reverse_iterator AttributeText<T>::rbegin() const
 	{
-		return content.cbegin();
+		return text.crbegin();
 	}
 
-	template<typename T> typename AttributeText<T>::const_reverse_iterator AttributeText<T>::crbegin()
+	template<typename T> typename AttributeText<T>::const_iterator AttributeText<T>::cbegin() const
 	{
-		return content.crbegin();
+		return text.cbegin();
+	}
+
+	template<typename T> typename AttributeText<T>::const_reverse_iterator AttributeText<T>::crbegin() const
+	{
+		return text.crbegin();
 	}
 
 	template<typename T> typename AttributeText<T>::iterator AttributeText<T>::end()
 	{
-		return content.end();
+		touch();
+		return text.end();
 	}
 
 	template<typename T> typename AttributeText<T>::reverse_iterator AttributeText<T>::rend()
 	{
-		return content.rend();
+		touch();
+		return text.rend();
+	}
+
+	template<typename T> typename AttributeText<T>::const_iterator AttributeText<T>::end() const
+	{
+		return text.cend();
+	}
+
+	template<typename T> typename AttributeText<T>::const_reverse_iterator AttributeText<T>::rend() const
+	{
+		return text.crend();
 	}
 
-	template<typename T> typename AttributeText<T>::const_iterator AttributeText<T>::cend()
+	template<typename T> typename AttributeText<T>::const_iterator AttributeText<T>::cend() const
 	{
-		return content.cend();
+		return text.cend();
 	}
 
-	template<typename T> typename AttributeText<T>::const_reverse_iterator AttributeText<T>::crend()
+	template<typename T> typename AttributeText<T>::const_reverse_iterator AttributeText<T>::crend() const
 	{
-		return content.crend();
+		return text.crend();
 	}
 
-	template<typename T> size_t AttributeText<T>::size()
+	template<typename T> size_t AttributeText<T>::size() const
 	{
-		return content.size();
+		return text.size();
 	}
 
-	template<typename T> size_t AttributeText<T>::length()
+	template<typename T> size_t AttributeText<T>::length() const
 	{
-		return content.length();
+		return text.length();
+	}
+
+	template<typename T> void AttributeText<T>::reserve(size_t n)
+	{
+		Counters::GrowthProbe<pmr::string> probe(text);
+		text.reserve(n);
+		if (!plainDirty)
+			plain.reserve(n);
 	}
 
 	template<typename T> void AttributeText<T>::clear()
 	{
-		content.clear();
+		text.clear();
+		spans.clear();
+		plain.clear();
+		plainDirty = false;
 	}
 
-	template<typename T> bool AttributeText<T>::empty()
+	template<typename T> bool AttributeText<T>::empty() const
 	{
-		return content.empty();
+		return text.empty();
 	}
 
 	template<typename T> char &AttributeText<T>::operator [] (size_t pos)
 	{
-		return content[pos].c;
+		touch();
+		return text[pos];
+	}
+
+	template<typename T> const char &AttributeText<T>::operator [] (size_t pos) const
+	{
+		return text[pos];
 	}
 
 	template<typename T> char &AttributeText<T>::at(size_t pos)
 	{
-		return content[pos].c;
+		touch();
+		return text.at(pos);
+	}
+
+	template<typename T> const char &AttributeText<T>::at(size_t pos) const
+	{
+		return text.at(pos);
 	}
 
 	template<typename T> char &AttributeText<T>::back()
 	{
-		return content.back().c;
+		touch();
+		return text.back();
+	}
+
+	template<typename T> const char &AttributeText<T>::back() const
+	{
+		return text.back();
 	}
 
 	template<typename T> char &AttributeText<T>::front()
 	{
-		return content.front().c;
+		touch();
+		return text.front();
+	}
+
+	template<typename T> const char &AttributeText<T>::front() const
+	{
+		return text.front();
 	}
 
 	template<typename T> AttributeText<T> &AttributeText<T>::operator += (const AttributeText<T> &t)
 	{
-		AttributeText<T> tmp(t);
-		tmp.applyQueue(attrQueue);
-		content.insert(content.end(), tmp.content.begin(), tmp.content.end());
+		return append(t);
 	}
 
-	template<typename T> AttributeText<T> &AttributeText<T>::operator += (const char *s)
+	template<typename T> AttributeText<T> &AttributeText<T>::operator += (AttributeText<T> &&t)
 	{
-		AttributeText<T> tmp = AttributeText<T>(s);
-		tmp.applyQueue(&attrQueue);
+		return append(std::move(t));
+	}
 
-		content.insert(content.end(), tmp.content.begin(), tmp.content.end());
-		return *this;
+	template<typename T> AttributeText<T> &AttributeText<T>::operator += (const char *s)
+	{
+		return append(s);
 	}
 
 	template<typename T> AttributeText<T> &AttributeText<T>::operator += (char c)
 	{
-		if (attrQueue != NULL)
+		return push_back(c);
+	}
+
+	template<typename T> AttributeText<T> &AttributeText<T>::append(const AttributeText<T> &t)
+	{
+		if (&t == this)
+			return append(AttributeText<T>(t));
+
+		Counters::GrowthProbe<pmr::string> probe(text);
+		size_t offset = text.size();
+		text.append(t.text);
+		if (!t.plainDirty)
 		{
-			content.push_back(Char(c, *attrQueue));
-			attrQueue = NULL;
+			if (!plainDirty)
+				plain.append(t.plain);
 		}
 		else
 		{
-			content.push_back(Char(c));
+			appendPlain(t.text.data(), t.text.size());
 		}
+
+		if (attrQueue != NULL && !t.text.empty() && (t.spans.empty() || t.spans.front().pos != 0))
+		{
+			spans.push_back(Span(offset, *attrQueue));
+			attrQueue = NULL;
+		}
+
+		reserveSpans(spans.size()+t.spans.size());
+		for (typename pmr::vector<Span>::const_iterator i = t.spans.begin(); i != t.spans.end(); i++)
+			spans.push_back(Span(i->pos+offset, i->attr));
+
+		return *this;
 	}
 
-	template<typename T> AttributeText<T> &AttributeText<T>::append(const AttributeText<T> &t)
+	template<typename T> AttributeText<T> &AttributeText<T>::append(AttributeText<T> &&t)
 	{
-		AttributeText<T> tmp(t);
-		tmp.applyQueue(attrQueue);
-		content.insert(content.end(), tmp.content.begin(), tmp.content.end());
+		if (&t == this)
+			return append(AttributeText<T>(t));
+
+		// appending to an empty text takes over the buffers instead of copying them
+		if (text.empty() && attrQueue == NULL)
+		{
+			spans.clear();
+			return *this = std::move(t);
+		}
+
+		Counters::GrowthProbe<pmr::string> probe(text);
+		size_t offset = text.size();
+		text.append(t.text);
+		if (!t.plainDirty)
+		{
+			if (!plainDirty)
+				plain.append(t.plain);
+		}
+		else
+		{
+			appendPlain(t.text.data(), t.text.size());
+		}
+
+		if (attrQueue != NULL && !t.text.empty() && (t.spans.empty() || t.spans.front().pos != 0))
+		{
+			spans.push_back(Span(offset, *attrQueue));
+			attrQueue = NULL;
+		}
+
+		reserveSpans(spans.size()+t.spans.size());
+		for (typename pmr::vector<Span>::iterator i = t.spans.begin(); i != t.spans.end(); i++)
+			spans.push_back(Span(i->pos+offset, std::move(i->attr)));
+
+		t.clear();
+		return *this;
 	}
 
 	template<typename T> AttributeText<T> &AttributeText<T>::append(const char *s)
 	{
-		AttributeText<T> tmp = AttributeText<T>(s);
-		tmp.applyQueue(attrQueue);
-		content.insert(content.end(), tmp.content.begin(), tmp.content.end());
+		Counters::GrowthProbe<pmr::string> probe(text);
+		size_t offset = text.size();
+		text.append(s);
+		appendPlain(text.data()+offset, text.size()-offset);
+		applyQueue(offset);
+		return *this;
 	}
 
 	template<typename T> AttributeText<T> &AttributeText<T>::append(const char *s, size_t n)
 	{
-		AttributeText<T> tmp = AttributeText<T>(s, n);
-		tmp.applyQueue(attrQueue);
-		content.insert(content.end(), tmp.content.begin(), tmp.content.end());
+		Counters::GrowthProbe<pmr::string> probe(text);
+		size_t offset = text.size();
+		text.append(s, n);
+		appendPlain(s, n);
+		applyQueue(offset);
+		return *this;
 	}
 
 	template<typename T> AttributeText<T> &AttributeText<T>::append(size_t n, char c)
 	{
-		AttributeText<T> tmp = AttributeText<T>(n, c);
-		tmp.applyQueue(attrQueue);
-		content.insert(content.end(), tmp.content.begin(), tmp.content.end());
+		Counters::GrowthProbe<pmr::string> probe(text);
+		size_t offset = text.size();
+		text.append(n, c);
+		if (c != 0 && !plainDirty)
+			plain.append(n, c);
+		applyQueue(offset);
+		return *this;
 	}
 
 	template<typename T> AttributeText<T> &AttributeText<T>::push_back(char c)
 	{
 		if (attrQueue != NULL)
 		{
-			content.push_back(Char(c, *attrQueue));
+			push_back(c, *attrQueue);
 			attrQueue = NULL;
 		}
 		else
 		{
-			content.push_back(Char(c));
+			Counters::GrowthProbe<pmr::string> probe(text);
+			text.push_back(c);
+			if (c != 0 && !plainDirty)
+				plain.push_back(c);
 		}
 
 		return *this;
@@ -475,230 +909,188 @@ namespace unixescape
 
 	template<typename T> AttributeText<T> &AttributeText<T>::push_back(char c, T a)
 	{
-		content.push_back(Char(c, a));
+		Counters::GrowthProbe<pmr::string> probe(text);
+		spans.push_back(Span(text.size(), std::move(a)));
+		text.push_back(c);
+		if (c != 0 && !plainDirty)
+			plain.push_back(c);
 		return *this;
 	}
 
 	template<typename T> AttributeText<T> &AttributeText<T>::insert(size_t pos, const AttributeText<T> &t)
 	{
-		content.insert(content.begin()+pos, t.content.begin(), t.content.end());
+		if (&t == this)
+			return insert(pos, AttributeText<T>(t));
+
+		Counters::GrowthProbe<pmr::string> probe(text);
+		text.insert(pos, t.text);
+		if (pos == text.size()-t.text.size())
+			appendPlain(t.text.data(), t.text.size());
+		else
+			touch();
+
+		typename pmr::vector<Span>::iterator i = spanAt(pos);
+		shiftSpans(i, t.text.size(), true);
+
+		size_t first = i-spans.begin();
+		spans.insert(i, t.spans.begin(), t.spans.end());
+		for (size_t j = first; j < first+t.spans.size(); j++)
+			spans[j].pos += pos;
+
+		return *this;
 	}
 
 	template<typename T> AttributeText<T> &AttributeText<T>::erase(size_t pos, size_t len)
 	{
-		content.erase(pos, len);
+		if (pos > text.size())
+			pos = text.size();
+		if (len > text.size()-pos)
+			len = text.size()-pos;
+
+		text.erase(pos, len);
+		touch();
+
+		typename pmr::vector<Span>::iterator first = spanAt(pos);
+		typename pmr::vector<Span>::iterator last = spanAt(pos+len);
+		shiftSpans(spans.erase(first, last), len, false);
+
+		return *this;
 	}
 
 	template<typename T> typename AttributeText<T>::iterator AttributeText<T>::erase(typename AttributeText<T>::iterator p)
 	{
-		content.erase(p);
+		size_t pos = p-text.begin();
+		erase(pos, 1);
+		return text.begin()+pos;
 	}
 
 	template<typename T> typename AttributeText<T>::iterator AttributeText<T>::erase(typename AttributeText<T>::iterator first, typename AttributeText<T>::iterator last)
 	{
-		content.erase(first, last);
+		size_t pos = first-text.begin();
+		erase(pos, last-first);
+		return text.begin()+pos;
 	}
 
 	template<typename T> AttributeText<T> &AttributeText<T>::replace(typename AttributeText<T>::iterator i1, typename AttributeText<T>::iterator i2, const AttributeText<T> &t)
 	{
-		content.replace(i1, i2, t.content);
+		size_t pos = i1-text.begin();
+		erase(pos, i2-i1);
+		return insert(pos, t);
 	}
 
 	template<typename T> void AttributeText<T>::swap(AttributeText<T> &t)
 	{
-		content.swap(t.content);
+		text.swap(t.text);
+		spans.swap(t.spans);
+		plain.swap(t.plain);
+		std::swap(plainDirty, t.plainDirty);
 	}
 
 	template<typename T> void AttributeText<T>::pop_back()
 	{
-		content.pop_back();
+		if (!spans.empty() && spans.back().pos == text.size()-1)
+			spans.pop_back();
+		if (text.back() != 0 && !plainDirty)
+			plain.pop_back();
+		text.pop_back();
 	}
 
 	template<typename T> const char *AttributeText<T>::c_str()
 	{
-		string tmp;
-		for (iterator i = content.begin(); i != content.end(); i++)
-		{
-			if (i->c != 0)
-			{
-				tmp.push_back(i->c);
-			}
-		}
-		return tmp.c_str();
+		return view().data();
 	}
 
 	template<typename T> const char *AttributeText<T>::data()
 	{
-		string tmp;
-		for (iterator i = content.begin(); i != content.end(); i++)
-		{
-			if (i->c != 0)
-			{
-				tmp.push_back(i->c);
-			}
-		}
-		return tmp.c_str();
+		return view().data();
 	}
 
 	template<typename T> size_t AttributeText<T>::find(const AttributeText<T> &t, size_t pos)
 	{
-		for (size_t i = pos; i < content.size()-t.content.size(); i++)
-		{
-			bool found = true;
-			for (size_t j = 0; j < t.content.size(); j++)
-			{
-				if (content[i+j] != t.content[j])
-				{
-					found = false;
-					break;
-				}
-			}
-
-			if (found == true)
-			{
-				return i;
-			}
-		}
+		if (pos > text.size())
+			return npos;
 
-		return npos;
+		size_t i = scanFind(text.data()+pos, text.size()-pos, t.text.data(), t.text.size());
+		return (i == npos) ? npos : pos+i;
 	}
 
 	template<typename T> size_t AttributeText<T>::find(const char *s, size_t pos)
 	{
-		for (size_t i = pos; i < content.size()-string(s).size(); i++)
-		{
-			bool found = true;
-			for (size_t j = 0; j < string(s).size(); j++)
-			{
-				if (content[i+j] != s[j])
-				{
-					found = false;
-					break;
-				}
-			}
-
-			if (found == true)
-			{
-				return i;
-			}
-		}
+		if (pos > text.size())
+			return npos;
 
-		return npos;
+		size_t i = scanFind(text.data()+pos, text.size()-pos, s, strlen(s));
+		return (i == npos) ? npos : pos+i;
 	}
 
 	template<typename T> size_t AttributeText<T>::find(char c, size_t pos)
 	{
-		for (size_t i = pos; i < content.size(); i++)
-		{
-			if (content[i] == c)
-			{
-				return i;
-			}
-		}
+		if (pos >= text.size())
+			return npos;
 
-		return npos;
+		const char *i = (const char *)memchr(text.data()+pos, c, text.size()-pos);
+		return (i == NULL) ? npos : i-text.data();
 	}
 
-	template<typename T> size_t AttributeText<T>::rfind(const AttributeText<T> &t, size_t pos)
+	template<typename T> size_t AttributeText<T>::find(const Searcher &s, size_t pos)
 	{
-		for (size_t i = content.size()-t.content.size()-1; i > pos; i++)
-		{
-			bool found = true;
-			for (size_t j = 0; j < t.content.size(); j++)
-			{
-				if (content[i+j] != t.content[j])
-				{
-					found = false;
-					break;
-				}
-			}
+		return s.find(chars(), pos);
+	}
 
-			if (found == true)
-			{
-				return i;
-			}
-		}
+	template<typename T> size_t AttributeText<T>::rfind(const AttributeText<T> &t, size_t pos)
+	{
+		size_t m = t.text.size();
+		if (m > text.size())
+			return npos;
 
-		return npos;
+		return scanRfind(text.data(), min(pos, text.size()-m)+m, t.text.data(), m);
 	}
 
 	template<typename T> size_t AttributeText<T>::rfind(const char *s, size_t pos)
 	{
-		for (size_t i = content.size()-string(s).size()-1; i > pos; i++)
-		{
-			bool found = true;
-			for (size_t j = 0; j < string(s).size(); j++)
-			{
-				if (content[i+j] != s[j])
-				{
-					found = false;
-					break;
-				}
-			}
-
-			if (found == true)
-			{
-				return i;
-			}
-		}
+		size_t m = strlen(s);
+		if (m > text.size())
+			return npos;
 
-		return npos;
+		return scanRfind(text.data(), min(pos, text.size()-m)+m, s, m);
 	}
 
 	template<typename T> size_t AttributeText<T>::rfind(char c, size_t pos)
 	{
-		for (size_t i = content.size()-1; i > pos; i++)
-		{
-			if (content[i] == c)
-			{
-				return i;
-			}
-		}
+		return text.rfind(c, pos);
+	}
 
-		return npos;
+	template<typename T> size_t AttributeText<T>::rfind(const Searcher &s, size_t pos)
+	{
+		return s.rfind(chars(), pos);
 	}
 
 	template<typename T> AttributeText<T> AttributeText<T>::substr(size_t pos, size_t len)
 	{
-		AttributeText<T> rtn;
-		if (len == npos)
-		{
-			vector<Char> tmp(content.begin(), content.end());
-			rtn = tmp;
-		}
-		else
-		{
-			vector<Char> tmp(content.begin()+pos, content.begin()+len);
-			rtn = tmp;
-		}
+		if (pos > text.size())
+			pos = text.size();
+		if (len > text.size()-pos)
+			len = text.size()-pos;
+
+		AttributeText<T> rtn(text.data()+pos, len);
+
+		typename pmr::vector<Span>::iterator last = spanAt(pos+len);
+		for (typename pmr::vector<Span>::iterator i = spanAt(pos); i != last; i++)
+			rtn.spans.push_back(Span(i->pos-pos, i->attr));
+
 		return rtn;
 	}
 
 	template<typename T> int AttributeText<T>::compare(const AttributeText<T> &t)
 	{
-		if (content.size() < t.content.size())
+		if (text.size() < t.text.size())
 		{
 			return -1;
 		}
-		else if (content.size() == t.content.size())
+		else if (text.size() == t.text.size())
 		{
-			for (size_t i = 0; i < content.size(); i++)
-			{
-				if (content[i].c < t.content[i].c)
-				{
-					return -1;
-				}
-				else if (content[i].c == t.content[i].c)
-				{
-					continue;
-				}
-				else
-				{
-					return 1;
-				}
-			}
-
-			return 0;
+			int r = text.compare(t.text);
+			return (r < 0) ? -1 : ((r > 0) ? 1 : 0);
 		}
 		else
 		{
@@ -708,34 +1100,19 @@ namespace unixescape
 
 	template<typename T> int AttributeText<T>::compare(size_t pos, size_t len, const AttributeText<T> &t)
 	{
-		if (pos+len > content.size())
+		if (pos+len > text.size())
 		{
 			return -1;
 		}
 
-		if (content.size() < t.content.size())
+		if (text.size() < t.text.size())
 		{
 			return -1;
 		}
-		else if (content.size() == t.content.size())
+		else if (text.size() == t.text.size())
 		{
-			for (size_t i = pos; i < pos+len; i++)
-			{
-				if (content[i].c < t.content[i].c)
-				{
-					return -1;
-				}
-				else if (content[i].c == t.content[i].c)
-				{
-					continue;
-				}
-				else
-				{
-					return 1;
-				}
-			}
-
-			return 0;
+			int r = text.compare(pos, len, t.text, pos, len);
+			return (r < 0) ? -1 : ((r > 0) ? 1 : 0);
 		}
 		else
 		{
@@ -753,28 +1130,44 @@ namespace unixescape
 		return compare(pos, len, AttributeText<T>(s));
 	}
 
+	template<typename T> pmr::memory_resource *AttributeText<T>::getResource()
+	{
+		return text.get_allocator().resource();
+	}
+
 	template<typename T> string AttributeText<T>::toStdString()
 	{
-		string tmp;
-		for (iterator i = content.begin(); i != content.end(); i++)
+		return string(view());
+	}
+
+	template<typename T> string_view AttributeText<T>::view()
+	{
+		if (plainDirty)
 		{
-			if (i->c != 0)
-			{
-				tmp.push_back(i->c);
-			}
+			plainDirty = false;
+			plain.reserve(text.size());
+			appendPlain(text.data(), text.size());
 		}
-		return tmp;
+
+		return string_view(plain.data(), plain.size());
+	}
+
+	template<typename T> string_view AttributeText<T>::chars() const
+	{
+		return string_view(text.data(), text.size());
 	}
 
 	template<typename T> string AttributeText<T>::toDebugString()
 	{
 		stringstream ss;
-		for (iterator i = content.begin(); i != content.end(); i++)
+		typename pmr::vector<Span>::iterator s = spans.begin();
+		for (size_t i = 0; i < text.size(); i++)
 		{
-			ss << " '" << i->getChar() << "'";
-			if (i->hasAttributes())
+			ss << " '" << text[i] << "'";
+			if (s != spans.end() && s->pos == i)
 			{
-				ss << " (" << i->getAttributes() << ")";
+				ss << " (" << s->attr << ")";
+				s++;
 			}
 		}
 		return ss.str().substr(1);
@@ -785,42 +1178,66 @@ namespace unixescape
 		attrQueue = &a;
 	}
 
+	template<typename T> bool AttributeText<T>::hasAttributes(size_t pos)
+	{
+		typename pmr::vector<Span>::iterator i = spanAt(pos);
+		return (i != spans.end() && i->pos == pos);
+	}
+
 	template<typename T> T &AttributeText<T>::getAttributes(size_t pos)
 	{
-		return content[pos].attr;
+		typename pmr::vector<Span>::iterator i = spanAt(pos);
+		if (i != spans.end() && i->pos == pos)
+			return i->attr;
+
+		thread_local static T none;
+		none = T();
+		return none;
+	}
+
+	template<typename T> typename AttributeText<T>::Char AttributeText<T>::charAt(size_t pos)
+	{
+		typename pmr::vector<Span>::iterator i = spanAt(pos);
+		if (i != spans.end() && i->pos == pos)
+			return Char(text[pos], i->attr);
+		return Char(text[pos]);
+	}
+
+	template<typename T> size_t AttributeText<T>::attributeCount()
+	{
+		return spans.size();
 	}
 
 	template<typename T> vector<typename AttributeText<T>::Segment> AttributeText<T>::splitByAttributes()
 	{
 		vector<Segment> rtn;
-		string buf;
 
-		for (iterator i = content.begin(); i != content.end(); i++)
+		for (SegmentIterator i = segments().begin(); i != SegmentIterator(); i++)
 		{
-			if (i->hasAttributes())
-			{
-				if (buf.empty() == false)
-				{
-					rtn.push_back(Segment(buf));
-					buf = "";
-				}
-
-				rtn.push_back(Segment(i->getAttributes()));
-				rtn.push_back(Segment(string(1, i->getChar())));
-			}
+			if (i->isAttribute())
+				rtn.push_back(Segment(const_cast<T &>(i->getAttribute())));
 			else
-			{
-				buf += i->getChar();
-			}
-		}
-
-		if (buf.empty() == false)
-		{
-			rtn.push_back(Segment(buf));
+				rtn.push_back(Segment(string(i->getString())));
 		}
 
 		return rtn;
 	}
+
+	template<typename T> typename AttributeText<T>::SegmentRange AttributeText<T>::segments()
+	{
+		SegmentRange r = {SegmentIterator(text, spans)};
+		return r;
+	}
+
+	template<typename T> CodePointRange AttributeText<T>::codePoints()
+	{
+		return unixescape::codePoints(chars());
+	}
+
+	template<typename T> GraphemeRange AttributeText<T>::graphemes()
+	{
+		return unixescape::graphemes(chars());
+	}
 }
 
-#endif
\ No newline at end of file
+#endif
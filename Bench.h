@@ -0,0 +1,330 @@
+/* Copyright 2013 Oliver Katz
+ *
+ * This file is part of LibUNIXEscape.
+ *
+ * LibUNIXEscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LibUNIXEscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LibUNIXEscape.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file Bench.h
+ *  \brief Benchmarking system used by the Bench*.cpp programs run by 'make bench'.
+ *  Contains a timer, a global allocation counter, generators for deterministic synthetic terminal
+ *  logs, and the output format: one JSON object per line, so results from different versions
+ *  can be compared by scripts.
+ *  \warning Replaces the global operator new and delete, so it must be included by exactly one
+ *  file of each benchmark program. */
+
+#ifndef __LIB_UNIX_ESCAPE_BENCH_H
+#define __LIB_UNIX_ESCAPE_BENCH_H
+
+#include "Util.h"
+#include "Scan.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+/*! Number of times each benchmark is repeated; the fastest run is reported. */
+#define UE_BENCH_RUNS 3
+
+namespace unixescape
+{
+	namespace bench
+	{
+		/*! Number of calls to the global operator new since the program started. */
+		inline atomic<size_t> &allocations()
+		{
+			static atomic<size_t> count(0);
+			return count;
+		}
+
+		/*! Result of one benchmark. */
+		typedef struct Result
+		{
+			/*! Seconds taken by the fastest run. */
+			double seconds;
+
+			/*! Allocations made by the fastest run. */
+			size_t allocs;
+		} Result;
+
+		/*! Runs \a f UE_BENCH_RUNS times and returns the time and allocations of the fastest run.
+		 *  \a setup is called before each run, and isn't timed. */
+		template<typename S, typename F> Result measure(S setup, F f)
+		{
+			Result best = {1e300, 0};
+			for (int i = 0; i < UE_BENCH_RUNS; i++)
+			{
+				setup();
+				size_t a = allocations().load();
+				chrono::steady_clock::time_point start = chrono::steady_clock::now();
+				f();
+				double s = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+				a = allocations().load()-a;
+
+				if (s < best.seconds)
+				{
+					best.seconds = s;
+					best.allocs = a;
+				}
+			}
+			return best;
+		}
+
+		/*! Runs \a f UE_BENCH_RUNS times and returns the time and allocations of the fastest run. */
+		template<typename F> Result measure(F f)
+		{
+			return measure([]() {}, f);
+		}
+
+		/*! Prints a result processing \a bytes bytes as one JSON line. */
+		inline void report(const char *name, const char *corpus, size_t bytes, Result r)
+		{
+			double mb = bytes/(1024.0*1024.0);
+			printf("{\"bench\":\"%s\",\"corpus\":\"%s\",\"bytes\":%zu,\"seconds\":%.6f,\"mb_per_sec\":%.1f,\"allocs_per_mb\":%.2f,\"scan\":\"%s\"}\n",
+				name, corpus, bytes, r.seconds, mb/r.seconds, r.allocs/mb, scanImplementation());
+			fflush(stdout);
+		}
+
+		/*! Small deterministic random number generator (xorshift), so every corpus is the same on every run. */
+		class Random
+		{
+			unsigned int state;
+
+		public:
+			Random(unsigned int seed) : state(seed) {}
+
+			unsigned int next(unsigned int n)
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				return state%n;
+			}
+		};
+
+		inline void word(string &s, Random &r)
+		{
+			static const char *words[] = {"the", "build", "of", "module", "failed", "with", "status", "linking",
+				"object", "files", "into", "target", "warning", "unused", "variable", "compiling", "source"};
+			s += words[r.next(sizeof(words)/sizeof(words[0]))];
+		}
+
+		/*! Plain text: lines of words with no escapes. */
+		inline string plainCorpus(size_t bytes)
+		{
+			Random r(1);
+			string s;
+			s.reserve(bytes+128);
+			while (s.size() < bytes)
+			{
+				for (int i = 0, n = 6+r.next(10); i < n; i++)
+				{
+					word(s, r);
+					s += ' ';
+				}
+				s += '\n';
+			}
+			return s;
+		}
+
+		/*! Compiler output: every line has several SGR color escapes. */
+		inline string sgrCorpus(size_t bytes)
+		{
+			Random r(2);
+			string s;
+			s.reserve(bytes+128);
+			while (s.size() < bytes)
+			{
+				s += "\033[1msrc/module";
+				s += to_string(r.next(100));
+				s += ".cpp:" + to_string(1+r.next(2000)) + ":" + to_string(1+r.next(80)) + ":\033[0m ";
+				s += (r.next(3) == 0) ? "\033[1;31merror:\033[0m " : "\033[1;35mwarning:\033[0m ";
+				word(s, r);
+				s += " \033[01m\033[K'";
+				word(s, r);
+				s += "'\033[m\033[K ";
+				word(s, r);
+				s += " [\033[01;35m\033[K-Wunused\033[m\033[K]\n";
+			}
+			return s;
+		}
+
+		/*! Full-screen TUI redraws: cursor positioning, erasing and reverse-video status lines. */
+		inline string tuiCorpus(size_t bytes)
+		{
+			Random r(3);
+			string s;
+			s.reserve(bytes+4096);
+			while (s.size() < bytes)
+			{
+				s += "\033[?25l\033[H\033[2J";
+				for (int row = 1; row <= 24; row++)
+				{
+					s += "\033[" + to_string(row) + ";1H";
+					if (r.next(4) == 0)
+						s += "\033[7m";
+					for (int i = 0, n = 2+r.next(8); i < n; i++)
+					{
+						word(s, r);
+						s += ' ';
+					}
+					s += "\033[0m\033[K";
+				}
+				s += "\033[24;" + to_string(1+r.next(80)) + "H\033[?25h";
+			}
+			return s;
+		}
+
+		/*! Progress bars: the same line rewritten many times with carriage returns. */
+		inline string progressCorpus(size_t bytes)
+		{
+			Random r(4);
+			string s;
+			s.reserve(bytes+128);
+			while (s.size() < bytes)
+			{
+				for (int p = 0; p <= 100; p += 1+r.next(5))
+				{
+					s += "\r[";
+					s.append(p/5, '#');
+					s.append(20-p/5, ' ');
+					s += "] " + to_string(p) + "% \033[K";
+				}
+				s += '\n';
+			}
+			return s;
+		}
+
+		/*! Localized plain text: lines mixing ASCII words with accented, Greek, CJK and emoji words. */
+		inline string utf8Corpus(size_t bytes)
+		{
+			static const char *words[] = {"caf\xc3\xa9", "\xce\xb1\xcf\x81\xcf\x87\xce\xb5\xce\xaf\xce\xbf",
+				"\xe6\x9e\x84\xe5\xbb\xba", "\xe5\xa4\xb1\xe6\x95\x97", "\xf0\x9f\x9a\x80", "\xe2\x9c\x94"};
+			Random r(5);
+			string s;
+			s.reserve(bytes+128);
+			while (s.size() < bytes)
+			{
+				for (int i = 0, n = 6+r.next(10); i < n; i++)
+				{
+					if (r.next(2) == 0)
+						word(s, r);
+					else
+						s += words[r.next(sizeof(words)/sizeof(words[0]))];
+					s += ' ';
+				}
+				s += '\n';
+			}
+			return s;
+		}
+
+		/*! The same text written as a C string literal, with escapes as backslash sequences
+		 *  (the input of replaceEscapes()). */
+		inline string escapedCorpus(const string &in)
+		{
+			string s;
+			s.reserve(in.size()*2);
+			for (size_t i = 0; i < in.size(); i++)
+			{
+				if (in[i] == '\033')
+					s += "\\x1b";
+				else if (in[i] == '\n')
+					s += "\\n";
+				else if (in[i] == '\r')
+					s += "\\r";
+				else if (in[i] == '\\')
+					s += "\\\\";
+				else
+					s += in[i];
+			}
+			return s;
+		}
+	}
+}
+
+void *operator new(size_t n)
+{
+	unixescape::bench::allocations()++;
+	void *p = malloc(n == 0 ? 1 : n);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t n)
+{
+	unixescape::bench::allocations()++;
+	void *p = malloc(n == 0 ? 1 : n);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	free(p);
+}
+
+void *operator new(size_t n, std::align_val_t a)
+{
+	unixescape::bench::allocations()++;
+	size_t align = (size_t)a;
+	void *p = aligned_alloc(align, (n+align-1)/align*align);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t n, std::align_val_t a)
+{
+	return operator new(n, a);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept
+{
+	free(p);
+}
+
+#endif
@@ -0,0 +1,73 @@
+#include "EscapeStream.h"
+#include "Bench.h"
+#include <thread>
+
+using namespace unixescape;
+
+/* Several threads parse the same log in 64KB chunks, keeping the results of a batch of chunks
+ * alive at once like a server answering requests, with the texts on the global heap and with
+ * the texts of each batch in a per-thread monotonic arena that is released in one call. */
+
+const size_t chunkSize = 64 << 10;
+const size_t batchSize = 8;
+
+void parseHeap(const string &corpus)
+{
+	EscapeStream es;
+	vector<AttributeText<EscapeStream::Attribute> > batch;
+	for (size_t pos = 0; pos < corpus.size(); pos += chunkSize)
+	{
+		es.stream().write(corpus.data()+pos, min(chunkSize, corpus.size()-pos));
+		batch.push_back(es.flush());
+		if (batch.size() == batchSize)
+			batch.clear();
+	}
+}
+
+void parseArena(const string &corpus)
+{
+	EscapeStream es;
+	const size_t bufferSize = 8 << 20;
+	unique_ptr<char[]> buffer(new char[bufferSize]);
+	pmr::monotonic_buffer_resource arena(buffer.get(), bufferSize);
+	vector<AttributeText<EscapeStream::Attribute> > batch;
+	for (size_t pos = 0; pos < corpus.size(); pos += chunkSize)
+	{
+		es.stream().write(corpus.data()+pos, min(chunkSize, corpus.size()-pos));
+		batch.push_back(es.flush(&arena));
+		if (batch.size() == batchSize)
+		{
+			batch.clear();
+			arena.release();
+		}
+	}
+}
+
+template<typename F> bench::Result run(size_t threads, F f)
+{
+	return bench::measure([&]()
+	{
+		vector<thread> pool;
+		for (size_t i = 0; i < threads; i++)
+			pool.push_back(thread(f));
+		for (size_t i = 0; i < threads; i++)
+			pool[i].join();
+	});
+}
+
+int main()
+{
+	const size_t threads[] = {1, 4};
+	string corpus = bench::sgrCorpus(4 << 20);
+
+	for (size_t i = 0; i < sizeof(threads)/sizeof(threads[0]); i++)
+	{
+		string name = "flush:heap:x"+to_string(threads[i]);
+		bench::Result r = run(threads[i], [&]() { parseHeap(corpus); });
+		bench::report(name.c_str(), "sgr", corpus.size()*threads[i], r);
+
+		name = "flush:arena:x"+to_string(threads[i]);
+		r = run(threads[i], [&]() { parseArena(corpus); });
+		bench::report(name.c_str(), "sgr", corpus.size()*threads[i], r);
+	}
+}
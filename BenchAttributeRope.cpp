@@ -0,0 +1,46 @@
+#include "AttributeRope.h"
+#include "Bench.h"
+
+using namespace unixescape;
+
+/* Random in-place edits (carriage-return overwrites and line insertions) on a large buffer,
+ * with the vector-backed AttributeText and with AttributeRope. */
+
+template<typename Text> void edit(Text &t, size_t ops)
+{
+	AttributeText<int> line("a line inserted in the middle of the buffer\n");
+	AttributeText<int> overwrite("progress: 42%");
+	bench::Random r(7);
+
+	for (size_t i = 0; i < ops; i++)
+	{
+		size_t pos = r.next(t.size());
+		if (i%2 == 0)
+		{
+			t.insert(pos, line);
+		}
+		else
+		{
+			t.erase(pos, overwrite.size());
+			t.insert(pos, overwrite);
+		}
+	}
+}
+
+int main()
+{
+	const size_t sizes[] = {1 << 20, 4 << 20, 16 << 20};
+	const size_t ops = 2000;
+
+	for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+	{
+		AttributeText<int> text;
+		AttributeRope<int> rope;
+
+		bench::Result r = bench::measure([&]() { text = AttributeText<int>(sizes[i], 'x'); }, [&]() { edit(text, ops); });
+		bench::report("edit:AttributeText", "overwrite", sizes[i], r);
+
+		r = bench::measure([&]() { rope = AttributeRope<int>(AttributeText<int>(sizes[i], 'x')); }, [&]() { edit(rope, ops); });
+		bench::report("edit:AttributeRope", "overwrite", sizes[i], r);
+	}
+}
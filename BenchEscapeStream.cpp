@@ -0,0 +1,56 @@
+#include "EscapeStream.h"
+#include "Bench.h"
+
+using namespace unixescape;
+
+/* Parser throughput on synthetic terminal logs: EscapeStream::flush and strip, then walking and
+ * converting its output, plus replaceEscapes on the same logs written as C literals and
+ * makeCharsPrintable back to them.
+ * flushParallel uses one thread per hardware thread. */
+
+int main()
+{
+	const size_t bytes = 16 << 20;
+	const char *names[] = {"plain", "sgr", "tui", "progress", "utf8"};
+	string corpora[] = {bench::plainCorpus(bytes), bench::sgrCorpus(bytes), bench::tuiCorpus(bytes), bench::progressCorpus(bytes), bench::utf8Corpus(bytes)};
+
+	for (size_t c = 0; c < sizeof(names)/sizeof(names[0]); c++)
+	{
+		const string &in = corpora[c];
+		EscapeStream es;
+		AttributeText<EscapeStream::Attribute> out;
+
+		bench::Result r = bench::measure([&]() { es.stream().str(in); }, [&]() { out = es.flush(); });
+		bench::report("flush", names[c], in.size(), r);
+
+		string stripped;
+		r = bench::measure([&]() { stripped.clear(); }, [&]() { es.strip(in, stripped); });
+		bench::report("strip", names[c], in.size(), r);
+
+		AttributeRope<EscapeStream::Attribute> rope;
+		r = bench::measure([&]() { es.stream().str(in); }, [&]() { rope = es.flushParallel(); });
+		bench::report("flushParallel", names[c], in.size(), r);
+
+		size_t segments = 0;
+		r = bench::measure([&]() { segments += out.splitByAttributes().size(); });
+		bench::report("splitByAttributes", names[c], in.size(), r);
+
+		r = bench::measure([&]() { for (auto seg : out.segments()) segments += seg.getString().size(); });
+		bench::report("segments", names[c], in.size(), r);
+
+		size_t plain = 0;
+		r = bench::measure([&]() { plain += out.toStdString().size(); });
+		bench::report("toStdString", names[c], in.size(), r);
+
+		string escaped = bench::escapedCorpus(in);
+		r = bench::measure([&]() { plain += replaceEscapes(escaped).size(); });
+		bench::report("replaceEscapes", names[c], escaped.size(), r);
+
+		string printable;
+		r = bench::measure([&]() { printable.clear(); plain += makeCharsPrintable(in, printable); });
+		bench::report("makeCharsPrintable", names[c], in.size(), r);
+
+		if (segments == 0 || plain == 0)
+			UE_ERROR("benchmark produced no output for corpus '" << names[c] << "'");
+	}
+}
@@ -0,0 +1,261 @@
+#include "Counters.h"
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+
+namespace unixescape
+{
+	namespace
+	{
+		/* Each thread writes only its own block, so an increment is a relaxed load and store,
+		 * which compiles to a plain add; readers only need the relaxed loads to be atomic. */
+		struct Block
+		{
+			std::atomic<uint64_t> counts[Counters::CounterCount];
+			std::atomic<uint64_t> escapes[Counters::maxOpcodes];
+			std::atomic<uint64_t> flushLatency[Counters::latencyBuckets];
+
+			Block()
+			{
+				for (size_t i = 0; i < Counters::CounterCount; i++)
+					counts[i].store(0, std::memory_order_relaxed);
+				for (size_t i = 0; i < Counters::maxOpcodes; i++)
+					escapes[i].store(0, std::memory_order_relaxed);
+				for (size_t i = 0; i < Counters::latencyBuckets; i++)
+					flushLatency[i].store(0, std::memory_order_relaxed);
+			}
+
+			void addTo(Counters::Snapshot &s) const
+			{
+				for (size_t i = 0; i < Counters::CounterCount; i++)
+					s.counts[i] += counts[i].load(std::memory_order_relaxed);
+				for (size_t i = 0; i < Counters::maxOpcodes; i++)
+					s.escapes[i] += escapes[i].load(std::memory_order_relaxed);
+				for (size_t i = 0; i < Counters::latencyBuckets; i++)
+					s.flushLatency[i] += flushLatency[i].load(std::memory_order_relaxed);
+			}
+		};
+
+		inline void bump(std::atomic<uint64_t> &a, uint64_t n)
+		{
+			a.store(a.load(std::memory_order_relaxed)+n, std::memory_order_relaxed);
+		}
+
+		/* The blocks of the running threads, plus the sum of those of exited threads. */
+		struct Registry
+		{
+			std::mutex lock;
+			std::vector<Block *> blocks;
+			Block retired;
+			Counters::Snapshot base = Counters::Snapshot();
+		};
+
+		Registry &registry()
+		{
+			// never destroyed, since threads may exit during static destruction
+			static Registry *r = new Registry();
+			return *r;
+		}
+
+		struct ThreadBlock
+		{
+			Block *block;
+
+			ThreadBlock() : block(new Block())
+			{
+				Registry &r = registry();
+				std::lock_guard<std::mutex> l(r.lock);
+				r.blocks.push_back(block);
+			}
+
+			~ThreadBlock()
+			{
+				Registry &r = registry();
+				std::lock_guard<std::mutex> l(r.lock);
+				Counters::Snapshot s = {};
+				block->addTo(s);
+				for (size_t i = 0; i < Counters::CounterCount; i++)
+					bump(r.retired.counts[i], s.counts[i]);
+				for (size_t i = 0; i < Counters::maxOpcodes; i++)
+					bump(r.retired.escapes[i], s.escapes[i]);
+				for (size_t i = 0; i < Counters::latencyBuckets; i++)
+					bump(r.retired.flushLatency[i], s.flushLatency[i]);
+				r.blocks.erase(std::find(r.blocks.begin(), r.blocks.end(), block));
+				delete block;
+			}
+		};
+
+		Block &local()
+		{
+			thread_local ThreadBlock t;
+			return *t.block;
+		}
+
+		Counters::Snapshot total()
+		{
+			Registry &r = registry();
+			Counters::Snapshot s = {};
+			std::lock_guard<std::mutex> l(r.lock);
+			r.retired.addTo(s);
+			for (size_t i = 0; i < r.blocks.size(); i++)
+				r.blocks[i]->addTo(s);
+			return s;
+		}
+
+		const char *names[] = {"bytes_parsed", "flushes", "escapes", "sequences_abandoned", "invalid_utf8",
+			"text_reallocations", "text_bytes_copied"};
+
+		const char *opcodeNames[] = {"control", "cursor_up", "cursor_down", "cursor_forward", "cursor_back",
+			"cursor_next_line", "cursor_previous_line", "cursor_column", "cursor_position", "erase_display",
+			"erase_line", "scroll_up", "scroll_down", "graphics", "device_status", "save_cursor", "restore_cursor",
+			"set_mode", "reset_mode", "ident", "other"};
+	}
+
+	std::atomic<bool> Counters::enabled(false);
+
+	Counters::Tally::Tally()
+	{
+		clear();
+	}
+
+	void Counters::Tally::clear()
+	{
+		std::fill(counts, counts+CounterCount, 0);
+		std::fill(escapes, escapes+maxOpcodes, 0);
+	}
+
+	void Counters::Tally::add(const Tally &t)
+	{
+		for (size_t i = 0; i < CounterCount; i++)
+			counts[i] += t.counts[i];
+		for (size_t i = 0; i < maxOpcodes; i++)
+			escapes[i] += t.escapes[i];
+	}
+
+	uint64_t Counters::Snapshot::get(Counter c) const
+	{
+		return counts[c];
+	}
+
+	uint64_t Counters::Snapshot::getEscapes(unsigned op) const
+	{
+		return (op < maxOpcodes) ? escapes[op] : 0;
+	}
+
+	uint64_t Counters::Snapshot::getLatencyPercentile(double p) const
+	{
+		uint64_t n = 0;
+		for (size_t i = 0; i < latencyBuckets; i++)
+			n += flushLatency[i];
+		if (n == 0)
+			return 0;
+
+		// the first bucket by which a fraction p of the flushes are counted
+		uint64_t rank = (uint64_t)(p*n+0.5), seen = 0;
+		if (rank < 1)
+			rank = 1;
+		size_t i;
+		for (i = 0; i < latencyBuckets; i++)
+		{
+			seen += flushLatency[i];
+			if (seen >= rank)
+				break;
+		}
+
+		// the last bucket also holds everything longer, so it has no upper bound
+		if (i >= latencyBuckets-1)
+			return UINT64_MAX;
+		return (uint64_t)1 << i;
+	}
+
+	std::string Counters::Snapshot::toString() const
+	{
+		std::string rtn;
+		char line[96];
+		for (size_t i = 0; i < CounterCount; i++)
+		{
+			snprintf(line, sizeof(line), "%s %llu\n", names[i], (unsigned long long)counts[i]);
+			rtn += line;
+		}
+		for (size_t i = 0; i < sizeof(opcodeNames)/sizeof(opcodeNames[0]); i++)
+		{
+			if (escapes[i] == 0)
+				continue;
+			snprintf(line, sizeof(line), "escapes_%s %llu\n", opcodeNames[i], (unsigned long long)escapes[i]);
+			rtn += line;
+		}
+		for (size_t i = 0; i < latencyBuckets; i++)
+		{
+			if (flushLatency[i] == 0)
+				continue;
+			if (i == latencyBuckets-1)
+				snprintf(line, sizeof(line), "flush_latency_le_inf %llu\n", (unsigned long long)flushLatency[i]);
+			else
+				snprintf(line, sizeof(line), "flush_latency_le_%llu %llu\n", (unsigned long long)1 << i, (unsigned long long)flushLatency[i]);
+			rtn += line;
+		}
+		return rtn;
+	}
+
+	void Counters::enable(bool on)
+	{
+		enabled.store(on, std::memory_order_relaxed);
+	}
+
+	void Counters::add(Counter c, uint64_t n)
+	{
+		bump(local().counts[c], n);
+	}
+
+	void Counters::add(const Tally &t)
+	{
+		Block &b = local();
+		for (size_t i = 0; i < CounterCount; i++)
+		{
+			if (t.counts[i] != 0)
+				bump(b.counts[i], t.counts[i]);
+		}
+		for (size_t i = 0; i < maxOpcodes; i++)
+		{
+			if (t.escapes[i] != 0)
+				bump(b.escapes[i], t.escapes[i]);
+		}
+	}
+
+	void Counters::addFlushLatency(uint64_t ns)
+	{
+		size_t bucket = (ns == 0) ? 0 : 64-__builtin_clzll(ns);
+		if (bucket >= latencyBuckets)
+			bucket = latencyBuckets-1;
+		bump(local().flushLatency[bucket], 1);
+	}
+
+	Counters::Snapshot Counters::snapshot()
+	{
+		// the counters only grow, so reset() records where they were and this subtracts it
+		Snapshot s = total();
+		Registry &r = registry();
+		std::lock_guard<std::mutex> l(r.lock);
+		for (size_t i = 0; i < CounterCount; i++)
+			s.counts[i] -= std::min(s.counts[i], r.base.counts[i]);
+		for (size_t i = 0; i < maxOpcodes; i++)
+			s.escapes[i] -= std::min(s.escapes[i], r.base.escapes[i]);
+		for (size_t i = 0; i < latencyBuckets; i++)
+			s.flushLatency[i] -= std::min(s.flushLatency[i], r.base.flushLatency[i]);
+		return s;
+	}
+
+	void Counters::reset()
+	{
+		Snapshot s = total();
+		Registry &r = registry();
+		std::lock_guard<std::mutex> l(r.lock);
+		r.base = s;
+	}
+
+	const char *Counters::getName(Counter c)
+	{
+		return (c < CounterCount) ? names[c] : "";
+	}
+}
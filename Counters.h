@@ -0,0 +1,188 @@
+/* Copyright 2013 Oliver Katz
+ *
+ * This file is part of LibUNIXEscape.
+ *
+ * LibUNIXEscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LibUNIXEscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LibUNIXEscape.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file Counters.h
+ *  \brief Contains Counters class, the library's opt-in performance counters.
+ *  Counting is off until Counters::enable() is called; until then each counting site costs one
+ *  relaxed atomic load. Every thread counts into its own block, which only it writes, so counting
+ *  needs no locked instructions, and snapshot() adds the blocks up when asked. */
+
+#ifndef __LIB_UNIX_ESCAPE_COUNTERS_H
+#define __LIB_UNIX_ESCAPE_COUNTERS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*! Namespace for all LibUNIXEscape classes/methods/global variables. */
+namespace unixescape
+{
+	/*! Process-wide performance counters of the parser and the containers. All methods are static
+	 *  and thread-safe. */
+	class Counters
+	{
+	public:
+		/*! The counted quantities. */
+		typedef enum Counter
+		{
+			/*! Bytes given to the parser. */
+			BytesParsed,
+			/*! Calls to EscapeStream::flush(), read() and flushParallel(). */
+			Flushes,
+			/*! Escapes and control characters parsed (the sum of the per-opcode counts). */
+			Escapes,
+			/*! Escape sequences discarded because they were malformed, oversized or cut off by
+			 *  another escape. */
+			SequencesAbandoned,
+			/*! Ill-formed UTF-8 characters dropped by the parser. */
+			InvalidUtf8,
+			/*! Times the character buffer of an AttributeText moved to a larger allocation. */
+			TextReallocations,
+			/*! Bytes copied into AttributeText character buffers, by appends and inserts and by
+			 *  the reallocations which moved them. */
+			TextBytesCopied,
+			/*! Number of counters. */
+			CounterCount
+		} Counter;
+
+		/*! Size of the per-opcode escape counts (at least EscapeStream::Attribute::OpcodeCount). */
+		static const size_t maxOpcodes = 32;
+
+		/*! Number of buckets of the flush latency histogram. Bucket 0 counts flushes under 1ns,
+		 *  bucket i those from 2^(i-1) up to 2^i nanoseconds, and the last bucket everything from
+		 *  2^(latencyBuckets-2) nanoseconds on, with no upper bound. */
+		static const size_t latencyBuckets = 40;
+
+		/*! Counts gathered by one object before being added to the counters, so that a hot loop
+		 *  can count into plain memory. */
+		typedef struct Tally
+		{
+			/*! The counts, indexed by Counter. */
+			uint64_t counts[CounterCount];
+
+			/*! Escapes parsed, indexed by EscapeStream::Attribute::Opcode. */
+			uint64_t escapes[maxOpcodes];
+
+			/*! Constructor. */
+			Tally();
+
+			/*! Sets every count to 0. */
+			void clear();
+
+			/*! Adds the counts of \a t. */
+			void add(const Tally &t);
+		} Tally;
+
+		/*! The counters at one point in time. */
+		typedef struct Snapshot
+		{
+			/*! The counts, indexed by Counter. */
+			uint64_t counts[CounterCount];
+
+			/*! Escapes parsed, indexed by EscapeStream::Attribute::Opcode. */
+			uint64_t escapes[maxOpcodes];
+
+			/*! Histogram of the time taken by each flush (see latencyBuckets). */
+			uint64_t flushLatency[latencyBuckets];
+
+			/*! Returns the count of \a c. */
+			uint64_t get(Counter c) const;
+
+			/*! Returns the number of escapes parsed with opcode \a op. */
+			uint64_t getEscapes(unsigned op) const;
+
+			/*! Returns an upper bound, in nanoseconds, of the time within which the fraction \a p
+			 *  (0 to 1) of the flushes completed, from the histogram. Returns 0 if there were none,
+			 *  and UINT64_MAX if the bound falls in the last, unbounded bucket. */
+			uint64_t getLatencyPercentile(double p) const;
+
+			/*! Returns the counters as text, one "name value" line per counter, then one
+			 *  "escapes_<opcode> value" line per opcode with a nonzero count and one
+			 *  "flush_latency_le_<ns> value" line per nonempty histogram bucket (the last one being
+			 *  "flush_latency_le_inf"), for exporting to a metrics system. */
+			std::string toString() const;
+		} Snapshot;
+
+	protected:
+		static std::atomic<bool> enabled;
+
+	public:
+		/*! Turns counting on or off for all threads. */
+		static void enable(bool on = true);
+
+		/*! Returns true if counting is on. */
+		static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+		/*! Adds \a n to the counter \a c of the calling thread. */
+		static void add(Counter c, uint64_t n = 1);
+
+		/*! Adds the counts of \a t to the counters of the calling thread. */
+		static void add(const Tally &t);
+
+		/*! Records a flush which took \a ns nanoseconds in the calling thread's histogram. */
+		static void addFlushLatency(uint64_t ns);
+
+		/*! Returns the sum of the counters of all threads (including threads which have exited)
+		 *  since the last reset(). */
+		static Snapshot snapshot();
+
+		/*! Starts the counters again from 0. */
+		static void reset();
+
+		/*! Returns the name of counter \a c, as used by Snapshot::toString(). */
+		static const char *getName(Counter c);
+
+		/*! Counts the growth of a character buffer between its construction and its destruction:
+		 *  put one on the stack before a method appends to the buffer. */
+		template<typename S> class GrowthProbe
+		{
+			const S *s;
+			size_t capacity;
+			size_t size;
+
+		public:
+			/*! Constructor. Remembers the size and capacity of \a buffer if counting is on. */
+			GrowthProbe(const S &buffer) : s(isEnabled() ? &buffer : NULL), capacity(0), size(0)
+			{
+				if (s != NULL)
+				{
+					capacity = s->capacity();
+					size = s->size();
+				}
+			}
+
+			/*! Destructor. Counts the bytes added and any reallocation. */
+			~GrowthProbe()
+			{
+				if (s == NULL)
+					return ;
+
+				bool moved = (s->capacity() != capacity);
+				if (moved)
+					add(TextReallocations);
+				add(TextBytesCopied, (s->size() > size ? s->size()-size : 0)+(moved ? size : 0));
+			}
+
+			GrowthProbe(const GrowthProbe &p) = delete;
+			GrowthProbe &operator = (const GrowthProbe &p) = delete;
+		};
+	};
+}
+
+#endif
@@ -0,0 +1,165 @@
+#include "EscapeEncoder.h"
+#include <cerrno>
+#include <climits>
+#include <poll.h>
+
+namespace unixescape
+{
+	namespace
+	{
+#ifdef IOV_MAX
+		const size_t maxPieces = IOV_MAX;
+#else
+		const size_t maxPieces = 1024;
+#endif
+
+		struct Counter
+		{
+			size_t n;
+
+			void operator () (string_view s)
+			{
+				n += s.size();
+			}
+		};
+
+		struct Copier
+		{
+			char *p;
+
+			void operator () (string_view s)
+			{
+				memcpy(p, s.data(), s.size());
+				p += s.size();
+			}
+		};
+	}
+
+	template<typename F> void EscapeEncoder::walk(AttributeText<Attribute> &t, F &f)
+	{
+		EscapeStream::visit(t, [&f](string_view s) { f(s); }, [&f](const Attribute &a) { f(a.getEscape()); });
+	}
+
+	void EscapeEncoder::gather(AttributeText<Attribute> &t)
+	{
+		auto add = [this](string_view s)
+		{
+			if (s.empty())
+				return ;
+
+			// pieces which follow each other in memory are written as one
+			if (!iov.empty())
+			{
+				iovec &last = iov.back();
+				if ((const char *)last.iov_base+last.iov_len == s.data())
+				{
+					last.iov_len += s.size();
+					return ;
+				}
+			}
+
+			iovec v;
+			v.iov_base = (void *)s.data();
+			v.iov_len = s.size();
+			iov.push_back(v);
+		};
+		walk(t, add);
+	}
+
+	bool EscapeEncoder::writeGathered(int fd)
+	{
+		size_t i = 0;
+		while (i < iov.size())
+		{
+			ssize_t n = ::writev(fd, &iov[i], (int)min(iov.size()-i, maxPieces));
+			if (n < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					pollfd p = {fd, POLLOUT, 0};
+					poll(&p, 1, -1);
+					continue;
+				}
+				UE_ERROR("cannot write to file descriptor " << fd << ": " << strerror(errno));
+				return false;
+			}
+
+			// skip the pieces written entirely, and the written part of the last one
+			size_t written = n;
+			while (i < iov.size() && written >= iov[i].iov_len)
+			{
+				written -= iov[i].iov_len;
+				i++;
+			}
+			if (written > 0)
+			{
+				iov[i].iov_base = (char *)iov[i].iov_base+written;
+				iov[i].iov_len -= written;
+			}
+		}
+		return true;
+	}
+
+	size_t EscapeEncoder::encodedSize(AttributeText<Attribute> &t)
+	{
+		Counter c = {0};
+		walk(t, c);
+		return c.n;
+	}
+
+	size_t EscapeEncoder::encodedSize(AttributeRope<Attribute> &r)
+	{
+		size_t n = 0;
+		r.forEachLeaf([&n](AttributeText<Attribute> &t)
+		{
+			n += encodedSize(t);
+		});
+		return n;
+	}
+
+	char *EscapeEncoder::encode(AttributeText<Attribute> &t, char *buf)
+	{
+		Copier c = {buf};
+		walk(t, c);
+		return c.p;
+	}
+
+	size_t EscapeEncoder::encode(AttributeText<Attribute> &t, string &out)
+	{
+		size_t start = out.size();
+		out.resize(start+encodedSize(t));
+		encode(t, &out[start]);
+		return out.size()-start;
+	}
+
+	size_t EscapeEncoder::encode(AttributeRope<Attribute> &r, string &out)
+	{
+		size_t start = out.size();
+		out.resize(start+encodedSize(r));
+		char *p = &out[start];
+		r.forEachLeaf([&p](AttributeText<Attribute> &t)
+		{
+			p = encode(t, p);
+		});
+		return out.size()-start;
+	}
+
+	bool EscapeEncoder::write(int fd, AttributeText<Attribute> &t)
+	{
+		iov.clear();
+		gather(t);
+		return writeGathered(fd);
+	}
+
+	bool EscapeEncoder::write(int fd, AttributeRope<Attribute> &r)
+	{
+		iov.clear();
+		r.forEachLeaf([this](AttributeText<Attribute> &t)
+		{
+			gather(t);
+		});
+		return writeGathered(fd);
+	}
+}
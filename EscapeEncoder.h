@@ -0,0 +1,84 @@
+/* Copyright 2013 Oliver Katz
+ *
+ * This file is part of LibUNIXEscape.
+ *
+ * LibUNIXEscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LibUNIXEscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LibUNIXEscape.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file EscapeEncoder.h
+ *  \brief Contains EscapeEncoder class, the reverse of EscapeStream::flush().
+ *  Text parsed by an EscapeStream is turned back into terminal bytes: plain text is written as it
+ *  is, and each attribute as the full text of its escape, in place of the 0 placeholder character
+ *  the parser attached it to. */
+
+#ifndef __LIB_UNIX_ESCAPE_ESCAPE_ENCODER_H
+#define __LIB_UNIX_ESCAPE_ESCAPE_ENCODER_H
+
+#include "EscapeStream.h"
+#include <sys/uio.h>
+
+/*! Namespace for all LibUNIXEscape classes/methods/global variables. */
+namespace unixescape
+{
+	/*! Class which serializes AttributeText<EscapeStream::Attribute> back to terminal bytes.
+	 *  The text and escapes are copied straight out of the AttributeText and the table of escapes,
+	 *  so encoding never allocates per segment. For input without malformed sequences, encoding
+	 *  the result of a flush() gives back the bytes that were flushed, including escapes stored in
+	 *  spill slots because the table of escapes was full.
+	 *  \warning Default-constructed attributes (see EscapeStream::Attribute::noEscape) have no
+	 *  text, and are written as nothing. */
+	class EscapeEncoder
+	{
+	public:
+		typedef EscapeStream::Attribute Attribute;
+
+	protected:
+		vector<iovec> iov;
+
+		template<typename F> static void walk(AttributeText<Attribute> &t, F &f);
+		void gather(AttributeText<Attribute> &t);
+		bool writeGathered(int fd);
+
+	public:
+		/*! Returns the number of bytes \a t encodes to. */
+		static size_t encodedSize(AttributeText<Attribute> &t);
+
+		/*! Returns the number of bytes \a r encodes to. */
+		static size_t encodedSize(AttributeRope<Attribute> &r);
+
+		/*! Writes \a t to \a buf, which must have room for encodedSize(t) bytes, and returns the end
+		 *  of the written bytes. */
+		static char *encode(AttributeText<Attribute> &t, char *buf);
+
+		/*! Appends \a t to \a out, growing it once, and returns the number of bytes appended. */
+		static size_t encode(AttributeText<Attribute> &t, string &out);
+
+		/*! Appends \a r to \a out, growing it once, and returns the number of bytes appended. */
+		static size_t encode(AttributeRope<Attribute> &r, string &out);
+
+		/*! Writes \a t to the file descriptor \a fd with writev(), pointing the system call straight at
+		 *  the text and escapes instead of copying them into a buffer. The list of pieces is kept for
+		 *  the next call. Partial writes are continued, and a non-blocking descriptor is waited on
+		 *  when it is full.
+		 *  \warning A write error is displayed and false is returned; some of \a t may have been
+		 *  written. */
+		bool write(int fd, AttributeText<Attribute> &t);
+
+		/*! Like write(int, AttributeText<Attribute> &), but writes every leaf of \a r with the same
+		 *  calls. */
+		bool write(int fd, AttributeRope<Attribute> &r);
+	};
+}
+
+#endif
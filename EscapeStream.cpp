@@ -1,171 +1,741 @@
 #include "EscapeStream.h"
+#include "Scan.h"
+#include "Utf8.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <cerrno>
+#include <unistd.h>
 
 namespace unixescape
 {
+	namespace
+	{
+		/* The table of escapes. Each distinct escape text is stored once, with the arguments after
+		 * the first two, in fixed-size blocks that never move, so looking an id up needs no lock;
+		 * adding a new text takes the writer lock. The table stops growing once its entries use
+		 * maxBytes, so hostile input can't make it use unbounded memory.
+		 * Each thread keeps a small cache of the texts it interned last in front of the map, so the
+		 * few distinct escapes of a typical stream are found without touching the shared lock.
+		 * Since entries never move or go away, a cached id stays right forever.
+		 * Once the table is full, each new escape gets a spill slot of its own, counting the
+		 * attributes which hold its id, and the slot goes back to a free list with the last of them.
+		 * Spill slots live in blocks that never move too, and a slot is only reused once nothing
+		 * can look it up, so looking one up needs no lock either. */
+		class EscapeTable
+		{
+		public:
+			struct Entry
+			{
+				string text;
+				vector<int> extra;
+				uint64_t subParams[EscapeStream::maxParams/64];
+
+				/* Stores the escape e with the arguments extra, and which of its arguments are
+				 * sub-parameters: argument n follows the n-th separator, up to the intermediates and
+				 * the final byte. */
+				void assign(string_view e, const int *p, size_t n)
+				{
+					text.assign(e.data(), e.size());
+					extra.assign(p, p+n);
+					for (size_t i = 0; i < EscapeStream::maxParams/64; i++)
+						subParams[i] = 0;
+
+					size_t seen = 0;
+					for (size_t i = 2; i < e.size() && seen+1 < EscapeStream::maxParams; i++)
+					{
+						unsigned char cls = parser::tables.cls[(unsigned char)e[i]];
+						if (cls == parser::ClassSeparator && e[i] == ':')
+							subParams[(seen+1)/64] |= (uint64_t)1 << ((seen+1)%64);
+						if (cls == parser::ClassSeparator)
+							seen++;
+						if (cls == parser::ClassIntermediate || e[i] >= '@')
+							break;
+					}
+				}
+
+				bool isSubParam(size_t n) const
+				{
+					return (n < EscapeStream::maxParams && (subParams[n/64] >> (n%64)) & 1);
+				}
+			};
+
+		protected:
+			static const uint32_t blockSize = 4096;
+			static const uint32_t maxBlocks = 1024;
+			static const size_t maxBytes = 64 << 20;
+			static const size_t cacheSize = 256;
+
+			/* A direct-mapped cache slot: the hash of a text and its id plus 1 (0 when empty). */
+			struct CacheSlot
+			{
+				size_t hash;
+				uint32_t id;
+			};
+
+			struct Spill
+			{
+				atomic<uint32_t> refs;
+				Entry entry;
+			};
+
+			static thread_local CacheSlot cache[cacheSize];
+
+			shared_mutex lock;
+			unordered_map<string_view, uint32_t> ids;
+			atomic<Entry *> blocks[maxBlocks];
+			atomic<uint32_t> count;
+			size_t bytes;
+			atomic<bool> full;
+
+			mutex spillLock;
+			atomic<Spill *> spillBlocks[maxBlocks];
+			atomic<uint32_t> spillCount;
+			vector<uint32_t> spillFree;
+
+			uint32_t spill(string_view e, const int *extra, size_t n)
+			{
+				lock_guard<mutex> l(spillLock);
+				uint32_t i;
+				if (!spillFree.empty())
+				{
+					i = spillFree.back();
+					spillFree.pop_back();
+				}
+				else
+				{
+					i = spillCount.load(memory_order_relaxed);
+					if (i >= blockSize*maxBlocks)
+						return EscapeStream::Attribute::noEscape;
+
+					Spill *block = spillBlocks[i/blockSize].load(memory_order_relaxed);
+					if (block == NULL)
+					{
+						block = new Spill[blockSize];
+						spillBlocks[i/blockSize].store(block, memory_order_release);
+					}
+					spillCount.store(i+1, memory_order_release);
+				}
+
+				Spill &slot = spillBlocks[i/blockSize].load(memory_order_relaxed)[i%blockSize];
+				slot.entry.assign(e, extra, n);
+				slot.refs.store(1, memory_order_release);
+				return EscapeStream::Attribute::spillBase+i;
+			}
+
+			Spill &spillSlot(uint32_t id)
+			{
+				uint32_t i = id-EscapeStream::Attribute::spillBase;
+				return spillBlocks[i/blockSize].load(memory_order_acquire)[i%blockSize];
+			}
+
+		public:
+			EscapeTable() : count(0), bytes(0), full(false), spillCount(0)
+			{
+				for (uint32_t i = 0; i < maxBlocks; i++)
+				{
+					blocks[i].store(NULL, memory_order_relaxed);
+					spillBlocks[i].store(NULL, memory_order_relaxed);
+				}
+			}
+
+			~EscapeTable()
+			{
+				for (uint32_t i = 0; i < maxBlocks; i++)
+				{
+					delete [] blocks[i].load(memory_order_relaxed);
+					delete [] spillBlocks[i].load(memory_order_relaxed);
+				}
+			}
+
+			uint32_t intern(string_view e, const int *extra, size_t n)
+			{
+				size_t h = hash<string_view>()(e);
+				CacheSlot &c = cache[h%cacheSize];
+				if (c.id != 0 && c.hash == h)
+				{
+					const Entry *hit = lookup(c.id-1);
+					if (hit != NULL && string_view(hit->text) == e)
+						return c.id-1;
+				}
+
+				// spill slots are not cached, since they are reused once freed
+				uint32_t id = insert(e, extra, n);
+				if (id < EscapeStream::Attribute::spillBase)
+				{
+					c.hash = h;
+					c.id = id+1;
+				}
+				return id;
+			}
+
+			uint32_t insert(string_view e, const int *extra, size_t n)
+			{
+				{
+					shared_lock<shared_mutex> r(lock);
+					unordered_map<string_view, uint32_t>::iterator i = ids.find(e);
+					if (i != ids.end())
+						return i->second;
+				}
+
+				// a full table only gets looked up, without the writer lock
+				if (full.load(memory_order_relaxed))
+					return spill(e, extra, n);
+
+				unique_lock<shared_mutex> w(lock);
+				unordered_map<string_view, uint32_t>::iterator i = ids.find(e);
+				if (i != ids.end())
+					return i->second;
+
+				uint32_t id = count.load(memory_order_relaxed);
+				size_t size = sizeof(Entry)+e.size()+n*sizeof(int);
+				if (id >= blockSize*maxBlocks || bytes+size > maxBytes)
+				{
+					if (!full.exchange(true))
+						UE_WARNING("the table of escapes is full, new escapes are stored with their attributes");
+					w.unlock();
+					return spill(e, extra, n);
+				}
+
+				Entry *block = blocks[id/blockSize].load(memory_order_relaxed);
+				if (block == NULL)
+				{
+					block = new Entry[blockSize];
+					blocks[id/blockSize].store(block, memory_order_release);
+				}
+
+				Entry &slot = block[id%blockSize];
+				slot.assign(e, extra, n);
+				ids[string_view(slot.text)] = id;
+				bytes += size;
+				count.store(id+1, memory_order_release);
+				return id;
+			}
+
+			const Entry *lookup(uint32_t id)
+			{
+				if (EscapeStream::Attribute::isSpilled(id))
+				{
+					if (id-EscapeStream::Attribute::spillBase >= spillCount.load(memory_order_acquire))
+						return NULL;
+					return &spillSlot(id).entry;
+				}
+				if (id >= count.load(memory_order_acquire))
+					return NULL;
+
+				return &blocks[id/blockSize].load(memory_order_acquire)[id%blockSize];
+			}
+
+			void retain(uint32_t id)
+			{
+				spillSlot(id).refs.fetch_add(1, memory_order_relaxed);
+			}
+
+			void release(uint32_t id)
+			{
+				Spill &slot = spillSlot(id);
+				if (slot.refs.fetch_sub(1, memory_order_acq_rel) != 1)
+					return ;
+
+				// give the memory back now rather than when the slot is reused
+				lock_guard<mutex> l(spillLock);
+				string().swap(slot.entry.text);
+				vector<int>().swap(slot.entry.extra);
+				spillFree.push_back(id-EscapeStream::Attribute::spillBase);
+			}
+		};
+
+		thread_local EscapeTable::CacheSlot EscapeTable::cache[EscapeTable::cacheSize];
+
+		EscapeTable &escapeTable()
+		{
+			static EscapeTable table;
+			return table;
+		}
+
+		const size_t readBufferSize = 64 << 10;
+
+		/* C++17 only gives the contents of a stringbuf as a copy, from str(), so this reaches the
+		 * buffer through stringbuf's protected members instead. */
+		class BufferAccess : public stringbuf
+		{
+		public:
+			static string_view data(stringbuf *b)
+			{
+				char *(stringbuf::*base)() const = &BufferAccess::pbase;
+				char *(stringbuf::*put)() const = &BufferAccess::pptr;
+				char *(stringbuf::*get)() const = &BufferAccess::egptr;
+
+				// the data ends at the put position, or at the end of the string given to str()
+				char *begin = (b->*base)();
+				char *end = max((b->*put)(), (b->*get)());
+				if (begin == NULL)
+					return string_view();
+				return string_view(begin, end-begin);
+			}
+		};
+
+		static_assert(EscapeStream::Attribute::OpcodeCount <= Counters::maxOpcodes, "too many opcodes to count");
+
+		/* Times one flush and adds the parser's counts to the thread's counters at its end, when
+		 * counting is on. */
+		class FlushCounter
+		{
+			Counters::Tally &tally;
+			bool on;
+			chrono::steady_clock::time_point start;
+
+		public:
+			FlushCounter(Counters::Tally &t) : tally(t), on(Counters::isEnabled())
+			{
+				if (on)
+					start = chrono::steady_clock::now();
+			}
+
+			~FlushCounter()
+			{
+				if (!on)
+					return ;
+
+				tally.counts[Counters::Flushes]++;
+				Counters::add(tally);
+				tally.clear();
+				Counters::addFlushLatency(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now()-start).count());
+			}
+		};
+
+		/* Visitor which builds the AttributeText returned by flush(). */
+		class TextOutput : public EscapeStream::Visitor
+		{
+			AttributeText<EscapeStream::Attribute> &t;
+
+		public:
+			TextOutput(AttributeText<EscapeStream::Attribute> &rtn) : t(rtn) {}
+
+			void onInput(string_view s)
+			{
+				t.reserve(t.size()+s.size());
+			}
+
+			void onText(string_view s, size_t pos)
+			{
+				if (s.size() == 1)
+					t.push_back(s[0]);
+				else
+					t.append(s.data(), s.size());
+			}
+
+			void onControl(char c, size_t pos)
+			{
+				t.push_back(0, EscapeStream::Attribute(EscapeStream::Attribute::Control, string_view(&c, 1)));
+			}
+
+			void onCsi(EscapeStream::Attribute::Opcode op, string_view seq, const int *params, size_t count, size_t pos)
+			{
+				t.push_back(0, EscapeStream::Attribute(op, seq, params, count));
+			}
+		};
+
+		/* Visitor for strip(), which only copies text and control characters: escapes are
+		 * dropped without being interned. */
+		class StripOutput : public EscapeStream::Visitor
+		{
+			string &o;
+			EscapeStream::OffsetMap *map;
+			size_t base;
+
+		public:
+			StripOutput(string &out, EscapeStream::OffsetMap *m) : o(out), map(m), base(0) {}
+
+			void setBase(size_t b)
+			{
+				base = b;
+			}
+
+			void onInput(string_view s)
+			{
+				o.reserve(o.size()+s.size());
+			}
+
+			void onText(string_view s, size_t pos)
+			{
+				if (map != NULL)
+					map->add(o.size(), base+pos);
+				o.append(s.data(), s.size());
+			}
+
+			void onControl(char c, size_t pos)
+			{
+				onText(string_view(&c, 1), pos);
+			}
+		};
+	}
+
+	EscapeStream::Attribute::Attribute(Opcode o, string_view e, const int *p, size_t n) : op(o), count((unsigned char)((n < maxParams) ? n : maxParams)), params{0, 0}
+	{
+		subParams = (n > 1 && e.find(':') != string_view::npos);
+		for (size_t i = 0; i < count && i < inlineParams; i++)
+			params[i] = p[i];
+		id = (count > inlineParams) ? intern(e, p+inlineParams, count-inlineParams) : intern(e);
+	}
+
+	EscapeStream::Attribute::Opcode EscapeStream::Attribute::getOpcode() const
+	{
+		return op;
+	}
+
+	string_view EscapeStream::Attribute::getEscape() const
+	{
+		return lookup(id);
+	}
+
+	size_t EscapeStream::Attribute::getParamCount() const
+	{
+		return count;
+	}
+
+	int EscapeStream::Attribute::getParam(size_t n) const
+	{
+		if (n >= count)
+			return 0;
+		if (n < inlineParams)
+			return params[n];
+
+		const EscapeTable::Entry *e = escapeTable().lookup(id);
+		if (e == NULL || n-inlineParams >= e->extra.size())
+			return 0;
+		return e->extra[n-inlineParams];
+	}
+
+	bool EscapeStream::Attribute::hasSubParams() const
+	{
+		return subParams;
+	}
+
+	bool EscapeStream::Attribute::isSubParam(size_t n) const
+	{
+		if (!subParams || n == 0 || n >= count)
+			return false;
+
+		// which arguments are sub-parameters was found once, when the escape was added
+		const EscapeTable::Entry *e = escapeTable().lookup(id);
+		return (e != NULL && e->isSubParam(n));
+	}
+
+	string_view EscapeStream::Attribute::getIntermediates() const
+	{
+		// intermediates run back from the byte before the final one
+		string_view e = getEscape();
+		if (op == Ident || e.size() < 3 || e[0] != '\033')
+			return string_view();
+
+		size_t end = e.size()-1, begin = end;
+		while (begin > 2 && parser::tables.cls[(unsigned char)e[begin-1]] == parser::ClassIntermediate)
+			begin--;
+		return e.substr(begin, end-begin);
+	}
+
+	bool EscapeStream::Attribute::operator == (const Attribute &a) const
+	{
+		if (id == noEscape || a.id == noEscape)
+			return (op == a.op && count == a.count && subParams == a.subParams && params[0] == a.params[0] && params[1] == a.params[1]);
+
+		// the same escape can be in several spill slots, and its text tells its arguments
+		if (isSpilled(id) || isSpilled(a.id))
+			return (op == a.op && (id == a.id || getEscape() == a.getEscape()));
+		return (id == a.id);
+	}
+
+	bool EscapeStream::Attribute::operator != (const Attribute &a) const
+	{
+		return !(*this == a);
+	}
+
+	uint32_t EscapeStream::Attribute::intern(string_view e, const int *extra, size_t n)
+	{
+		return escapeTable().intern(e, extra, n);
+	}
+
+	string_view EscapeStream::Attribute::lookup(uint32_t id)
+	{
+		const EscapeTable::Entry *e = escapeTable().lookup(id);
+		return (e == NULL) ? string_view() : string_view(e->text);
+	}
+
+	void EscapeStream::Attribute::retain(uint32_t id)
+	{
+		escapeTable().retain(id);
+	}
+
+	void EscapeStream::Attribute::release(uint32_t id)
+	{
+		escapeTable().release(id);
+	}
+
+	void EscapeStream::OffsetMap::add(size_t output, size_t input)
+	{
+		// a byte which continues the last run in both the output and the input needs no new run
+		if (!runs.empty() && output-runs.back().output == input-runs.back().input)
+			return ;
+
+		Run r = {output, input};
+		runs.push_back(r);
+	}
+
+	size_t EscapeStream::OffsetMap::getInputOffset(size_t output) const
+	{
+		vector<Run>::const_iterator i = upper_bound(runs.begin(), runs.end(), output, [](size_t o, const Run &r) { return (o < r.output); });
+		if (i == runs.begin())
+			return 0;
+		i--;
+		return i->input+(output-i->output);
+	}
+
+	void EscapeStream::OffsetMap::clear()
+	{
+		runs.clear();
+	}
+
 	stringstream &EscapeStream::stream()
 	{
 		return ss;
 	}
 
+	void EscapeStream::resume(const EscapeStream &e)
+	{
+		state = e.state;
+		seq = e.seq;
+		params = e.params;
+		arg = e.arg;
+		paramSeen = e.paramSeen;
+		marker = e.marker;
+		intermediates = e.intermediates;
+	}
+
+	void EscapeStream::parseText(string_view s, AttributeText<Attribute> &rtn)
+	{
+		TextOutput out(rtn);
+		parseInto(s, out);
+	}
+
+	void EscapeStream::commit()
+	{
+		if (!Counters::isEnabled())
+			return ;
+
+		Counters::add(tally);
+		tally.clear();
+	}
+
+	string_view EscapeStream::buffered()
+	{
+		return BufferAccess::data(ss.rdbuf());
+	}
+
+	void EscapeStream::clearStream()
+	{
+		ss.str("");
+		ss.clear();
+	}
+
 	AttributeText<EscapeStream::Attribute> EscapeStream::flush(char numchar)
 	{
-		string s = ss.str();
+		FlushCounter counter(tally);
+		AttributeText<Attribute> rtn;
+		parseText(buffered(), rtn);
+		clearStream();
+		return rtn;
+	}
+
+	AttributeText<EscapeStream::Attribute> EscapeStream::flush(pmr::memory_resource *mr, char numchar)
+	{
+		FlushCounter counter(tally);
+		AttributeText<Attribute> rtn(mr);
+		parseText(buffered(), rtn);
+		clearStream();
+		return rtn;
+	}
+
+	AttributeText<EscapeStream::Attribute> EscapeStream::flush(string_view s)
+	{
+		FlushCounter counter(tally);
 		AttributeText<Attribute> rtn;
+		parseText(buffered(), rtn);
+		clearStream();
+		parseText(s, rtn);
+		return rtn;
+	}
 
-		for (size_t i = 0; i < s.size(); i++)
+	AttributeText<EscapeStream::Attribute> EscapeStream::read(int fd, bool untilEnd)
+	{
+		FlushCounter counter(tally);
+		AttributeText<Attribute> rtn;
+		parseText(buffered(), rtn);
+		clearStream();
+
+		if (readBuffer.empty())
+			readBuffer.resize(readBufferSize);
+
+		while (true)
+		{
+			ssize_t n = ::read(fd, readBuffer.data(), readBuffer.size());
+			if (n < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				if (errno != EAGAIN && errno != EWOULDBLOCK)
+					UE_ERROR("cannot read from file descriptor " << fd << ": " << strerror(errno));
+				break;
+			}
+			if (n == 0)
+				break;
+
+			parseText(string_view(readBuffer.data(), n), rtn);
+			if (!untilEnd)
+				break;
+		}
+
+		return rtn;
+	}
+
+	void EscapeStream::parseParallel(string_view s, WorkPool &pool, size_t chunkSize, AttributeRope<Attribute> &rtn)
+	{
+		if (s.empty())
+			return ;
+		if (chunkSize == 0)
+			chunkSize = 1;
+
+		// cut at the first escape in the window after each chunk, or at the end of the window
+		// (moved back to the start of a UTF-8 character)
+		size_t window = chunkSize/8+1;
+		vector<size_t> cuts(1, 0);
+		for (size_t pos = chunkSize; pos < s.size(); pos = cuts.back()+chunkSize)
+		{
+			size_t n = min(window, s.size()-pos);
+			const char *e = (const char *)memchr(s.data()+pos, '\033', n);
+			size_t cut = (e == NULL) ? pos+n : e-s.data();
+			if (cut == s.size())
+				break;
+			for (int k = 0; k < 3 && cut > cuts.back()+1 && ((unsigned char)s[cut] & 0xc0) == 0x80; k++)
+				cut--;
+			cuts.push_back(cut);
+		}
+		cuts.push_back(s.size());
+
+		size_t count = cuts.size()-1;
+		vector<unique_ptr<EscapeStream> > parsers(count);
+		vector<AttributeText<Attribute> > parts(count);
+
+		// the first chunk continues this parser's state, the others start in plain text
+		pool.run(count, [&](size_t i)
 		{
-			if (isprint(s[i]))
+			EscapeStream *e = this;
+			if (i > 0)
 			{
-				rtn.push_back(s[i]);
+				parsers[i].reset(new EscapeStream());
+				e = parsers[i].get();
 			}
-			else
+			e->parseText(string_view(s.data()+cuts[i], cuts[i+1]-cuts[i]), parts[i]);
+		});
+
+		for (size_t i = 0; i < count; i++)
+		{
+			if (i > 0)
 			{
-				if (string("\n\r\t\b\x7f\a\x5").find(s[i]) != string::npos)
+				EscapeStream *prev = (i == 1) ? this : parsers[i-1].get();
+				if (prev->state != Ground && s[cuts[i]] != '\033')
 				{
-					rtn.push_back(0, Attribute(string(1, s[i])));
+					// the guess was wrong: the chunk starts inside a sequence
+					EscapeStream *e = parsers[i].get();
+					e->resume(*prev);
+					parts[i].clear();
+					e->tally.clear();
+					e->parseText(string_view(s.data()+cuts[i], cuts[i+1]-cuts[i]), parts[i]);
 				}
-				else if (s[i] == '\033')
+				else if (prev->state != Ground && Counters::isEnabled())
 				{
-					i++;
-					if (i >= s.size())
-					{
-						break;
-					}
-					else if (s[i] != '[')
-					{
-						continue;
-					}
+					// the guess was right, but the escape which starts the chunk cut off what the
+					// last chunk was in the middle of, as a serial parse would have counted
+					if (prev->state == Utf8Tail)
+						tally.counts[Counters::InvalidUtf8]++;
+					else if (prev->state != CsiIgnore)
+						tally.counts[Counters::SequencesAbandoned]++;
+				}
+				tally.add(parsers[i]->tally);
+			}
+			rtn.append(std::move(parts[i]));
+		}
 
-					i++;
-					if (i >= s.size())
-					{
-						break;
-					}
+		if (count > 1)
+		{
+			resume(*parsers[count-1]);
+		}
+	}
 
-					if (string("ABCDEFGJKSTmsu").find(s[i]) != string::npos)
-					{
-						rtn.push_back(0, Attribute(string("\033[")+s[i]));
-					}
-					else if (s[i] == 'i')
-					{
-						i++;
-						if (i >= s.size())
-						{
-							break;
-						}
-						else if (s[i] != '@')
-						{
-							continue;
-						}
-
-						int j = 0;
-						while(s[i+1+j] != '@' && i+1+j < s.size())
-							j++;
-
-						if (i+1+j >= s.size())
-						{
-							break;
-						}
-						else if (j == 0)
-						{
-							i++;
-							continue;
-						}
-						else
-						{
-							rtn.push_back(0, Attribute(string("\033[i@"+s.substr(i+1, j)+"@")));
-						}
-					}
-					else if (s[i] == '?')
-					{
-						int j = 0;
-						while(isdigit(s[i+1+j]) && i+1+j < s.size())
-							j++;
+	AttributeRope<EscapeStream::Attribute> EscapeStream::flushParallel(WorkPool &pool, size_t chunkSize)
+	{
+		FlushCounter counter(tally);
+		AttributeRope<Attribute> rtn;
+		parseParallel(buffered(), pool, chunkSize, rtn);
+		clearStream();
+		return rtn;
+	}
 
-						if (i+1+j >= s.size())
-						{
-							break;
-						}
-						else if (j == 0)
-						{
-							i++;
-							continue;
-						}
-						else
-						{
-							Attribute a;
-							a.i1 = atoi(s.substr(i+1, j).c_str());
-							i += 1+j;
-
-							if (s[i] == 'l' || s[i] == 'h')
-							{
-								a.escape = string("\033[?")+s.substr(i-j-1, j)+s[i];
-								rtn.push_back(0, a);
-							}
-						}
-					}
-					else
-					{
-						int j = 0;
-						while (isdigit(s[i+1+j]) && i+1+j < s.size())
-							j++;
+	AttributeRope<EscapeStream::Attribute> EscapeStream::flushParallel(string_view s, WorkPool &pool, size_t chunkSize)
+	{
+		FlushCounter counter(tally);
+		AttributeText<Attribute> head;
+		parseText(buffered(), head);
+		clearStream();
 
-						if (i+1+j >= s.size())
-						{
-							break;
-						}
-						else if (j == 0)
-						{
-							i++;
-							continue;
-						}
-						else
-						{
-							Attribute a;
-							string s1 = s.substr(i+1, j);
-							a.i1 = atoi(s1.c_str());
-							i += 1+j;
-
-							if (string("ABCDEFGJKSTnm").find(s[i]) != string::npos)
-							{
-								a.escape = string("\033[")+s1+s[i];
-								rtn.push_back(0, a);
-							}
-							else if (s[i] == ';')
-							{
-								int k = 0;
-								while(isdigit(s[i+1+k]) && i+1+k < s.size())
-									k++;
-
-								if (i+1+k >= s.size())
-								{
-									break;
-								}
-								else if (k == 0)
-								{
-									i++;
-									continue;
-								}
-								else
-								{
-									string s2 = s.substr(i+1, k);
-									a.i2 = atoi(s2.c_str());
-									i += 1+k;
-
-									if (string("Hfm").find(s[i]) != string::npos)
-									{
-										a.escape = string("\033[")+s1+";"+s2+s[i];
-										rtn.push_back(0, a);
-									}
-								}
-							}
-						}
-					}
-				}
-			}
-		}
+		AttributeRope<Attribute> rtn;
+		rtn.append(std::move(head));
+		parseParallel(s, pool, chunkSize, rtn);
+		return rtn;
+	}
 
-		ss.str("");
+	size_t EscapeStream::strip(string_view s, string &out, OffsetMap *map)
+	{
+		FlushCounter counter(tally);
+		size_t start = out.size();
+		StripOutput o(out, map);
+
+		string_view b = buffered();
+		parseInto(b, o);
+		o.setBase(b.size());
+		clearStream();
+
+		parseInto(s, o);
+		return out.size()-start;
+	}
+
+	string EscapeStream::strip(string_view s)
+	{
+		string rtn;
+		strip(s, rtn);
 		return rtn;
 	}
+
+	string EscapeStream::strip()
+	{
+		FlushCounter counter(tally);
+		string rtn;
+		StripOutput o(rtn, NULL);
+		parseInto(buffered(), o);
+		clearStream();
+		return rtn;
+	}
+
+	bool EscapeStream::pending()
+	{
+		return (state != Ground);
+	}
+
+	void EscapeStream::reset()
+	{
+		abandon();
+	}
 }
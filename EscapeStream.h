@@ -24,6 +24,11 @@
 
 #include "Util.h"
 #include "AttributeText.h"
+#include "AttributeRope.h"
+#include "WorkPool.h"
+#include "Counters.h"
+#include "Scan.h"
+#include "Utf8.h"
 
 /*! Namespace for all LibUNIXEscape classes/methods/global variables. */
 namespace unixescape
@@ -34,35 +39,856 @@ namespace unixescape
 	class EscapeStream
 	{
 	public:
-		/*! The attribute type used by the AttributeText resulting from the stream. */
+		/*! The attribute type used by the AttributeText resulting from the stream.
+		 *  An attribute is a small value: the kind of escape, its first two integral arguments and the id
+		 *  of its full text in a process-wide table of escapes, which stores each distinct escape once,
+		 *  together with any further arguments. Once the table is full, a new escape is stored in a
+		 *  spill slot of its own instead, which is shared by the copies of its attribute and freed with
+		 *  the last of them, so a long-running process never loses escapes nor keeps them forever. */
 		typedef struct Attribute
 		{
-			/*! The full text of the escape. */
-			string escape;
+			/*! The kinds of escapes recognized by the parser. */
+			typedef enum Opcode : unsigned char
+			{
+				/*! A single control character (\\n, \\r, \\t, \\b, \\x7f, \\a or \\x5). */
+				Control,
+				/*! ESC [ n A */
+				CursorUp,
+				/*! ESC [ n B */
+				CursorDown,
+				/*! ESC [ n C */
+				CursorForward,
+				/*! ESC [ n D */
+				CursorBack,
+				/*! ESC [ n E */
+				CursorNextLine,
+				/*! ESC [ n F */
+				CursorPreviousLine,
+				/*! ESC [ n G */
+				CursorColumn,
+				/*! ESC [ n ; m H and ESC [ n ; m f */
+				CursorPosition,
+				/*! ESC [ n J */
+				EraseDisplay,
+				/*! ESC [ n K */
+				EraseLine,
+				/*! ESC [ n S */
+				ScrollUp,
+				/*! ESC [ n T */
+				ScrollDown,
+				/*! ESC [ n m */
+				Graphics,
+				/*! ESC [ n n */
+				DeviceStatus,
+				/*! ESC [ s */
+				SaveCursor,
+				/*! ESC [ u */
+				RestoreCursor,
+				/*! ESC [ ? n h */
+				SetMode,
+				/*! ESC [ ? n l */
+				ResetMode,
+				/*! ESC [ i @ ... @ */
+				Ident,
+				/*! Any other control sequence: ESC [, an optional private marker (< = > ?), arguments
+				 *  separated by ; or :, optional intermediate bytes (space to /) and a final byte
+				 *  (@ to ~). */
+				Other,
+				/*! Number of opcodes. */
+				OpcodeCount
+			} Opcode;
 
-			/*! The integral arguments found in the escape (0 by default). */
-			int i1, i2;
+			/*! Id of an attribute without an escape text (a default-constructed one). */
+			static const uint32_t noEscape = 0xffffffff;
 
-			/*! Constructor. */
-			Attribute() : i1(0), i2(0) {}
+			/*! First id of the spill slots, which hold the escapes added once the table is full. */
+			static const uint32_t spillBase = 0x80000000;
+
+			/*! Number of integral arguments stored in the attribute itself. */
+			static const size_t inlineParams = 2;
+
+			/*! The kind of escape.
+			 *  \warning It is recomended to use getOpcode() instead. */
+			Opcode op;
+
+			/*! The number of integral arguments found in the escape.
+			 *  \warning It is recomended to use getParamCount() instead. */
+			unsigned char count;
+
+			/*! True if some argument is a sub-parameter, separated from the one before it by ':'.
+			 *  \warning It is recomended to use hasSubParams() instead. */
+			bool subParams;
+
+			/*! The id of the full text of the escape.
+			 *  \warning It is recomended to use getEscape() instead. */
+			uint32_t id;
+
+			/*! The first integral arguments found in the escape (0 by default).
+			 *  \warning It is recomended to use getParam() instead. */
+			int params[inlineParams];
 
 			/*! Constructor. */
-			Attribute(string e, int _i1 = 0, int _i2 = 0) : escape(e), i1(_i1), i2(_i2) {}
+			Attribute() : op(Control), count(0), subParams(false), id(noEscape), params{0, 0} {}
+
+			/*! Copy constructor. */
+			Attribute(const Attribute &a) : op(a.op), count(a.count), subParams(a.subParams), id(a.id), params{a.params[0], a.params[1]}
+			{
+				if (isSpilled(id))
+					retain(id);
+			}
+
+			/*! Move constructor. */
+			Attribute(Attribute &&a) : op(a.op), count(a.count), subParams(a.subParams), id(a.id), params{a.params[0], a.params[1]}
+			{
+				a.id = noEscape;
+			}
+
+			/*! Destructor. */
+			~Attribute()
+			{
+				if (isSpilled(id))
+					release(id);
+			}
+
+			/*! Assignment operator. */
+			Attribute &operator = (const Attribute &a)
+			{
+				if (isSpilled(a.id))
+					retain(a.id);
+				if (isSpilled(id))
+					release(id);
+				op = a.op;
+				count = a.count;
+				subParams = a.subParams;
+				id = a.id;
+				params[0] = a.params[0];
+				params[1] = a.params[1];
+				return *this;
+			}
+
+			/*! Move assignment operator. */
+			Attribute &operator = (Attribute &&a)
+			{
+				if (this == &a)
+					return *this;
+				if (isSpilled(id))
+					release(id);
+				op = a.op;
+				count = a.count;
+				subParams = a.subParams;
+				id = a.id;
+				params[0] = a.params[0];
+				params[1] = a.params[1];
+				a.id = noEscape;
+				return *this;
+			}
+
+			/*! Constructor. The text of the escape is looked up in (or added to) the table of escapes. */
+			Attribute(Opcode o, string_view e, unsigned char n = 0, int p1 = 0, int p2 = 0) : op(o), count(n), subParams(false), id(intern(e)), params{p1, p2} {}
+
+			/*! Constructor. The text of the escape and the \a n arguments \a p are looked up in (or
+			 *  added to) the table of escapes. The text tells which arguments are sub-parameters. */
+			Attribute(Opcode o, string_view e, const int *p, size_t n);
+
+			/*! Gets the kind of escape. */
+			Opcode getOpcode() const;
+
+			/*! Gets the full text of the escape. The view stays valid for the lifetime of the process,
+			 *  or, for an escape in a spill slot, as long as the attribute or a copy of it. */
+			string_view getEscape() const;
+
+			/*! Gets the number of integral arguments found in the escape. */
+			size_t getParamCount() const;
+
+			/*! Gets an integral argument of the escape (0 if there is no such argument). */
+			int getParam(size_t n) const;
+
+			/*! Returns true if some argument is a sub-parameter, as in ESC [ 4 : 3 m, where 3 qualifies 4
+			 *  instead of being an argument of its own. */
+			bool hasSubParams() const;
+
+			/*! Returns true if argument \a n is a sub-parameter of the one before it (separated from it
+			 *  by ':' rather than ';'). Which arguments are sub-parameters is stored with the escape's
+			 *  text, so this takes constant time. */
+			bool isSubParam(size_t n) const;
+
+			/*! Gets the intermediate bytes of a control sequence (space to /, just before the final
+			 *  byte), which are empty for most escapes. */
+			string_view getIntermediates() const;
+
+			/*! Comparison operator. */
+			bool operator == (const Attribute &a) const;
+
+			/*! Comparison operator. */
+			bool operator != (const Attribute &a) const;
+
+			/*! Returns the id of the escape text \a e in the table of escapes, adding it if needed.
+			 *  The arguments after the first two, \a extra (\a n of them), are stored with a new text.
+			 *  If the table is full, returns the id of a new spill slot holding one reference, which
+			 *  the caller must pass to release(). */
+			static uint32_t intern(string_view e, const int *extra = NULL, size_t n = 0);
+
+			/*! Returns the escape text with id \a id in the table of escapes. */
+			static string_view lookup(uint32_t id);
+
+			/*! Returns true if \a id is the id of a spill slot. */
+			static bool isSpilled(uint32_t id) { return (id >= spillBase && id != noEscape); }
+
+			/*! Adds a reference to the spill slot \a id. */
+			static void retain(uint32_t id);
+
+			/*! Drops a reference to the spill slot \a id, freeing it with the last one. */
+			static void release(uint32_t id);
 		} Attribute;
 
+		/*! The states of the incremental escape parser. */
+		typedef enum State
+		{
+			/*! Plain text. */
+			Ground,
+			/*! An escape character has been read. */
+			Escape,
+			/*! A control sequence introducer (escape followed by '[') has been read. */
+			CsiEntry,
+			/*! Reading the private marker and arguments of a control sequence. */
+			CsiParam,
+			/*! Reading the intermediate bytes of a control sequence. */
+			CsiIntermediate,
+			/*! Skipping a malformed or oversized control sequence up to its final byte. */
+			CsiIgnore,
+			/*! An escape, '[' and 'i' have been read, expecting '@'. */
+			IdentAt,
+			/*! An escape, '[', 'i' and '@' have been read, no body read yet. */
+			IdentBodyStart,
+			/*! Reading the body of an escape, '[', 'i', '@' ... '@' sequence. */
+			IdentBody,
+			/*! Plain text, in the middle of a UTF-8 encoded character. */
+			Utf8Tail,
+			/*! Number of parser states. */
+			StateCount
+		} State;
+
+		/*! Maximum number of arguments of a control sequence. Longer sequences are skipped. */
+		static const size_t maxParams = 128;
+
+		/*! Maximum length of an escape sequence. Control sequences which grow longer are skipped,
+		 *  and ident sequences abandoned. */
+		static const size_t maxSequence = 4096;
+
+		/*! Map from the bytes written by strip() back to the input bytes they were copied from.
+		 *  It holds one run per stretch of output copied from consecutive input bytes, so text
+		 *  with few escapes needs few runs. */
+		typedef struct OffsetMap
+		{
+			/*! The output byte at position \a output and the ones after it, up to the next run,
+			 *  were copied from the input starting at position \a input. */
+			typedef struct Run
+			{
+				size_t output;
+				size_t input;
+			} Run;
+
+			/*! The runs, by increasing output position. */
+			vector<Run> runs;
+
+			/*! Records that the output byte at \a output was copied from the input byte at \a input. */
+			void add(size_t output, size_t input);
+
+			/*! Returns the input position of the output byte at \a output. */
+			size_t getInputOffset(size_t output) const;
+
+			/*! Removes all runs. */
+			void clear();
+		} OffsetMap;
+
+		/*! Base of the visitors given to parse(). A visitor derives from it and defines the
+		 *  callbacks it needs, hiding the empty ones here. parse() is a template over the visitor's
+		 *  type, so the callbacks are called without virtual dispatch and can be inlined. Each
+		 *  callback gets the position in the parsed input of the first byte of what it reports, or
+		 *  0 for something which started in an earlier call. */
+		class Visitor
+		{
+		public:
+			/*! Called with the whole input before it is parsed. */
+			void onInput(string_view s) {}
+
+			/*! Called with a run of plain text (printable ASCII and well-formed UTF-8). \a s points
+			 *  into the input, except for a character completed from an earlier call. */
+			void onText(string_view s, size_t pos) {}
+
+			/*! Called with a control character (\\n, \\r, \\t, \\b, \\x7f, \\a or \\x5). */
+			void onControl(char c, size_t pos) {}
+
+			/*! Called with a finished control or ident sequence: its kind, its whole text and its
+			 *  arguments, which are only valid during the call. */
+			void onCsi(Attribute::Opcode op, string_view seq, const int *params, size_t count, size_t pos) {}
+		};
+
 	protected:
+		/* The arguments of the control sequence being parsed: the first ones are stored inline, and
+		 * the list only moves to the heap past them. The heap buffer is kept for the next sequence. */
+		class ParamList
+		{
+			static const size_t inlineCount = 16;
+
+			int local[inlineCount];
+			vector<int> heap;
+			size_t n;
+
+		public:
+			ParamList() : n(0) {}
+
+			bool push_back(int p);
+			const int *data() const;
+			size_t size() const;
+			void clear();
+		};
+
 		stringstream ss;
 
+		State state;
+		string seq;
+		ParamList params;
+		int arg;
+		bool paramSeen;
+		char marker;
+		bool intermediates;
+
+		vector<char> readBuffer;
+		Counters::Tally tally;
+
+		void abandon();
+		void resume(const EscapeStream &e);
+		template<typename V> void parseInto(string_view s, V &v);
+		void parseText(string_view s, AttributeText<Attribute> &rtn);
+		void commit();
+		void parseParallel(string_view s, WorkPool &pool, size_t chunkSize, AttributeRope<Attribute> &rtn);
+		string_view buffered();
+		void clearStream();
+
 	public:
 		/*! Constructor. */
-		EscapeStream() {}
+		EscapeStream() : state(Ground), arg(0), paramSeen(false), marker(0), intermediates(false) {}
 
 		/*! Gets reference to the stream object. */
 		stringstream &stream();
 
-		/*! Erases the stream object's data and returns an AttributeText object with the parsed data. */
+		/*! Erases the stream object's data and returns an AttributeText object with the parsed data.
+		 *  Plain text is printable ASCII and UTF-8 encoded characters; other control bytes and
+		 *  ill-formed UTF-8 are dropped. An escape sequence or character which is cut off at the end
+		 *  of the stream's data is kept by the parser and completed by the data of the next flush(),
+		 *  so the stream can be fed and flushed in chunks of any size. */
 		AttributeText<Attribute> flush(char numchar = '%');
+
+		/*! Like flush(), but the returned AttributeText allocates from \a mr, for example a
+		 *  std::pmr::monotonic_buffer_resource which frees a whole batch of flushes at once. */
+		AttributeText<Attribute> flush(pmr::memory_resource *mr, char numchar = '%');
+
+		/*! Parses \a s directly, without copying it into the stream, and returns it as flush() would.
+		 *  Anything already written to the stream is parsed first, and a sequence cut off at the end
+		 *  of \a s is completed by the next flush, so s can be one part of a larger input. */
+		AttributeText<Attribute> flush(string_view s);
+
+		/*! Reads from the file descriptor \a fd and parses the data as it arrives, through a read
+		 *  buffer which is kept for the next call. Reads until end of file if \a untilEnd is true, or
+		 *  until read() would block on a non-blocking descriptor; otherwise returns after one read().
+		 *  Anything already written to the stream is parsed first.
+		 *  \warning A read error is displayed, and the data read before it is returned. */
+		AttributeText<Attribute> read(int fd, bool untilEnd = true);
+
+		/*! Like flush(), but parses the data in chunks of about \a chunkSize bytes on the threads of
+		 *  \a pool, and returns the chunks joined without copying, each one leaf of an AttributeRope.
+		 *  The result is identical to flush()'s.
+		 *  Chunks are cut just before an escape byte where possible, because an escape restarts the
+		 *  parser whatever state it was in. Otherwise a chunk is parsed as if it started in plain
+		 *  text, and parsed again once the previous chunk is done if that one ended in the middle
+		 *  of a sequence. */
+		AttributeRope<Attribute> flushParallel(WorkPool &pool = WorkPool::shared(), size_t chunkSize = 1 << 20);
+
+		/*! Like flush(string_view), but parses \a s in parallel as flushParallel() does, for example
+		 *  the view() of a MappedFile. */
+		AttributeRope<Attribute> flushParallel(string_view s, WorkPool &pool = WorkPool::shared(), size_t chunkSize = 1 << 20);
+
+		/*! Parses \a s and calls the callbacks of \a visitor (see Visitor) with its text, control
+		 *  characters and escape sequences, in order, without building an AttributeText. Sequences
+		 *  and characters carry over between calls as they do between flushes, but data written to
+		 *  the stream is not parsed. flush() and strip() are visitors of the same parser. */
+		template<typename V> void parse(string_view s, V &visitor);
+
+		/*! Parses \a s like flush(string_view), but instead of building an AttributeText only
+		 *  appends the plain text and the control characters to \a out, so escape sequences are
+		 *  removed. Returns the number of bytes appended. If \a map is not NULL, it records where
+		 *  each appended byte came from, counting input positions from the start of the data
+		 *  written to the stream followed by \a s. A character completed from the last call maps
+		 *  to position 0. */
+		size_t strip(string_view s, string &out, OffsetMap *map = NULL);
+
+		/*! Returns \a s stripped as strip(string_view, string &, OffsetMap *) does. */
+		string strip(string_view s);
+
+		/*! Like flush(), but returns the stream's data stripped of escape sequences, as
+		 *  strip(string_view, string &, OffsetMap *) does. */
+		string strip();
+
+		/*! Returns true if the parser is in the middle of an escape sequence or a UTF-8 character
+		 *  carried over from the last flush(). */
+		bool pending();
+
+		/*! Discards any partially parsed escape sequence or character carried over from the last flush(). */
+		void reset();
+
+		/*! Calls \a text with each run of plain text of \a t (a string_view) and \a escape with each
+		 *  of its attributes (a const Attribute &), in order. The 0 placeholder characters the
+		 *  attributes are attached to are skipped. */
+		template<typename F, typename G> static void visit(AttributeText<Attribute> &t, F text, G escape);
 	};
+
+	template<typename F, typename G> void EscapeStream::visit(AttributeText<Attribute> &t, F text, G escape)
+	{
+		// the segment after an attribute is the character it is attached to
+		bool attached = false;
+		for (const AttributeText<Attribute>::SegmentView &s : t.segments())
+		{
+			if (s.isAttribute())
+			{
+				escape(s.getAttribute());
+				attached = true;
+				continue;
+			}
+
+			string_view v = s.getString();
+			if (!(attached && v.size() == 1 && v[0] == 0))
+				text(v);
+			attached = false;
+		}
+	}
+
+	/*! The parser's tables and helpers, used by EscapeStream::parse(). */
+	namespace parser
+	{
+		/* Every byte is mapped to one of these classes by a 256-entry table, and the parser's
+		 * next state and action are looked up from the current state and the byte's class. */
+		enum ByteClass
+		{
+			ClassIgnore,        // non-printable bytes which are dropped
+			ClassControl,       // \n \r \t \b \x7f \a \x5
+			ClassEsc,           // \033
+			ClassIntermediate,  // space to /
+			ClassDigit,         // 0-9
+			ClassSeparator,     // : ;
+			ClassPrivate,       // < = > ?
+			ClassBracket,       // [
+			ClassIdent,         // i
+			ClassAt,            // @
+			ClassFinal,         // the other bytes from @ to ~
+			ClassUtf8,          // 0x80 to 0xff
+			ClassCount
+		};
+
+		enum Action
+		{
+			ActDrop,         // ignore the byte
+			ActText,         // append the byte as plain text
+			ActControl,      // append the byte as a control attribute
+			ActStart,        // discard the sequence in progress and start a new one
+			ActCollect,      // add the byte to the sequence in progress
+			ActDigit,        // add the byte to the sequence and to the current argument
+			ActSeparator,    // add the byte to the sequence and end the current argument
+			ActMarker,       // add the byte to the sequence as its private marker
+			ActIntermediate, // add the byte to the sequence as an intermediate byte
+			ActIgnore,       // discard the sequence in progress, and skip up to its final byte
+			ActEmit,         // add the byte to the sequence and append the finished sequence
+			ActAbandon,      // discard the sequence in progress and the byte
+			ActUtf8          // append the UTF-8 character starting with the byte as plain text
+		};
+
+		struct Tables
+		{
+			unsigned char cls[256];
+			unsigned char trans[EscapeStream::StateCount][ClassCount];
+		};
+
+		constexpr unsigned char entry(Action a, EscapeStream::State s)
+		{
+			return (unsigned char)((a << 4) | s);
+		}
+
+		constexpr Tables makeTables()
+		{
+			typedef EscapeStream E;
+			Tables t = {};
+
+			for (int b = 0; b < 256; b++)
+				t.cls[b] = ClassIgnore;
+			for (int b = 0x20; b < 0x30; b++)
+				t.cls[b] = ClassIntermediate;
+			for (int b = '0'; b <= '9'; b++)
+				t.cls[b] = ClassDigit;
+			for (int b = '@'; b <= '~'; b++)
+				t.cls[b] = ClassFinal;
+			for (int b = 0x80; b < 0x100; b++)
+				t.cls[b] = ClassUtf8;
+			for (const char *p = "\n\r\t\b\x7f\a\x5"; *p != 0; p++)
+				t.cls[(unsigned char)*p] = ClassControl;
+			t.cls['\033'] = ClassEsc;
+			t.cls[':'] = ClassSeparator;
+			t.cls[';'] = ClassSeparator;
+			t.cls['<'] = ClassPrivate;
+			t.cls['='] = ClassPrivate;
+			t.cls['>'] = ClassPrivate;
+			t.cls['?'] = ClassPrivate;
+			t.cls['['] = ClassBracket;
+			t.cls['i'] = ClassIdent;
+			t.cls['@'] = ClassAt;
+
+			// by default a sequence is abandoned on an unexpected byte, and an escape restarts it
+			for (int s = 0; s < E::StateCount; s++)
+			{
+				for (int c = 0; c < ClassCount; c++)
+					t.trans[s][c] = entry(ActAbandon, E::Ground);
+				t.trans[s][ClassEsc] = entry(ActStart, E::Escape);
+			}
+
+			// in plain text everything but control bytes is printable
+			for (int c = 0; c < ClassCount; c++)
+				t.trans[E::Ground][c] = entry(ActText, E::Ground);
+			t.trans[E::Ground][ClassIgnore] = entry(ActDrop, E::Ground);
+			t.trans[E::Ground][ClassControl] = entry(ActControl, E::Ground);
+			t.trans[E::Ground][ClassEsc] = entry(ActStart, E::Escape);
+			t.trans[E::Ground][ClassUtf8] = entry(ActUtf8, E::Ground);
+
+			t.trans[E::Escape][ClassBracket] = entry(ActCollect, E::CsiEntry);
+
+			// a control sequence ends at its first final byte, wherever it is
+			const int finals[] = {ClassFinal, ClassBracket, ClassIdent, ClassAt};
+			for (int f : finals)
+			{
+				t.trans[E::CsiEntry][f] = entry(ActEmit, E::Ground);
+				t.trans[E::CsiParam][f] = entry(ActEmit, E::Ground);
+				t.trans[E::CsiIntermediate][f] = entry(ActEmit, E::Ground);
+				t.trans[E::CsiIgnore][f] = entry(ActAbandon, E::Ground);
+			}
+			t.trans[E::CsiEntry][ClassIdent] = entry(ActCollect, E::IdentAt);
+
+			t.trans[E::CsiEntry][ClassDigit] = entry(ActDigit, E::CsiParam);
+			t.trans[E::CsiEntry][ClassSeparator] = entry(ActSeparator, E::CsiParam);
+			t.trans[E::CsiEntry][ClassPrivate] = entry(ActMarker, E::CsiParam);
+			t.trans[E::CsiEntry][ClassIntermediate] = entry(ActIntermediate, E::CsiIntermediate);
+
+			// a private marker is only allowed first, and arguments only before intermediates
+			t.trans[E::CsiParam][ClassDigit] = entry(ActDigit, E::CsiParam);
+			t.trans[E::CsiParam][ClassSeparator] = entry(ActSeparator, E::CsiParam);
+			t.trans[E::CsiParam][ClassPrivate] = entry(ActIgnore, E::CsiIgnore);
+			t.trans[E::CsiParam][ClassIntermediate] = entry(ActIntermediate, E::CsiIntermediate);
+
+			t.trans[E::CsiIntermediate][ClassIntermediate] = entry(ActIntermediate, E::CsiIntermediate);
+			t.trans[E::CsiIntermediate][ClassDigit] = entry(ActIgnore, E::CsiIgnore);
+			t.trans[E::CsiIntermediate][ClassSeparator] = entry(ActIgnore, E::CsiIgnore);
+			t.trans[E::CsiIntermediate][ClassPrivate] = entry(ActIgnore, E::CsiIgnore);
+
+			t.trans[E::CsiIgnore][ClassIntermediate] = entry(ActDrop, E::CsiIgnore);
+			t.trans[E::CsiIgnore][ClassDigit] = entry(ActDrop, E::CsiIgnore);
+			t.trans[E::CsiIgnore][ClassSeparator] = entry(ActDrop, E::CsiIgnore);
+			t.trans[E::CsiIgnore][ClassPrivate] = entry(ActDrop, E::CsiIgnore);
+
+			t.trans[E::IdentAt][ClassAt] = entry(ActCollect, E::IdentBodyStart);
+
+			// the body of an ident sequence may contain anything but '@' and escapes
+			for (int c = 0; c < ClassCount; c++)
+			{
+				t.trans[E::IdentBodyStart][c] = entry(ActCollect, E::IdentBody);
+				t.trans[E::IdentBody][c] = entry(ActCollect, E::IdentBody);
+			}
+			t.trans[E::IdentBodyStart][ClassEsc] = entry(ActStart, E::Escape);
+			t.trans[E::IdentBody][ClassEsc] = entry(ActStart, E::Escape);
+			t.trans[E::IdentBodyStart][ClassAt] = entry(ActAbandon, E::Ground);
+			t.trans[E::IdentBody][ClassAt] = entry(ActEmit, E::Ground);
+
+			return t;
+		}
+
+		inline constexpr Tables tables = makeTables();
+
+		struct Opcodes
+		{
+			EscapeStream::Attribute::Opcode op[256];
+		};
+
+		constexpr Opcodes makeOpcodes()
+		{
+			typedef EscapeStream::Attribute A;
+			Opcodes o = {};
+			const char *finals = "ABCDEFGHfJKSTmnsu";
+			const A::Opcode ops[] = {A::CursorUp, A::CursorDown, A::CursorForward, A::CursorBack, A::CursorNextLine,
+				A::CursorPreviousLine, A::CursorColumn, A::CursorPosition, A::CursorPosition, A::EraseDisplay,
+				A::EraseLine, A::ScrollUp, A::ScrollDown, A::Graphics, A::DeviceStatus, A::SaveCursor, A::RestoreCursor};
+
+			for (int b = 0; b < 256; b++)
+				o.op[b] = A::Other;
+			for (int i = 0; finals[i] != 0; i++)
+				o.op[(unsigned char)finals[i]] = ops[i];
+			return o;
+		}
+
+		inline constexpr Opcodes opcodes = makeOpcodes();
+
+		inline int addDigit(int arg, char c)
+		{
+			// saturate instead of overflowing on absurdly long arguments
+			return (arg < 100000000) ? arg*10+(c-'0') : arg;
+		}
+	}
+
+	inline bool EscapeStream::ParamList::push_back(int p)
+	{
+		if (n == maxParams)
+			return false;
+
+		if (n < inlineCount)
+		{
+			local[n] = p;
+		}
+		else
+		{
+			if (n == inlineCount)
+				heap.assign(local, local+inlineCount);
+			heap.push_back(p);
+		}
+		n++;
+		return true;
+	}
+
+	inline const int *EscapeStream::ParamList::data() const
+	{
+		return (n <= inlineCount) ? local : heap.data();
+	}
+
+	inline size_t EscapeStream::ParamList::size() const
+	{
+		return n;
+	}
+
+	inline void EscapeStream::ParamList::clear()
+	{
+		n = 0;
+		heap.clear();
+	}
+
+	inline void EscapeStream::abandon()
+	{
+		state = Ground;
+		seq.clear();
+		params.clear();
+		arg = 0;
+		paramSeen = false;
+		marker = 0;
+		intermediates = false;
+	}
+
+	template<typename V> void EscapeStream::parseInto(string_view s, V &v)
+	{
+		const unsigned char *begin = (const unsigned char *)s.data();
+		const unsigned char *p = begin;
+		const unsigned char *end = p+s.size();
+		v.onInput(s);
+
+		// counts go to the parser's tally, which the flush or parse() adds to the thread's counters
+		bool counting = Counters::isEnabled();
+		if (counting)
+			tally.counts[Counters::BytesParsed] += s.size();
+
+		for (; p != end; p++)
+		{
+			if (state == Utf8Tail)
+			{
+				// the character carried over from the last flush is completed, continued or broken
+				seq.push_back((char)*p);
+				int len = checkUtf8(seq.data(), seq.size());
+				if (len < 0)
+					continue;
+				if (len > 0)
+				{
+					v.onText(string_view(seq.data(), len), 0);
+					abandon();
+					continue;
+				}
+
+				// drop the broken character, and read the byte again as plain text
+				abandon();
+				if (counting)
+					tally.counts[Counters::InvalidUtf8]++;
+			}
+
+			if (state == Ground)
+			{
+				// copy whole runs of printable text and well-formed UTF-8 at once
+				size_t n = scanText((const char *)p, end-p);
+				if (n > 0)
+				{
+					v.onText(string_view((const char *)p, n), p-begin);
+					p += n;
+					if (p == end)
+						break;
+				}
+			}
+
+			unsigned char t = parser::tables.trans[state][parser::tables.cls[*p]];
+			State next = (State)(t & 0xf);
+			char c = (char)*p;
+
+			switch (t >> 4)
+			{
+			case parser::ActDrop:
+				break;
+
+			case parser::ActText:
+				v.onText(string_view((const char *)p, 1), p-begin);
+				break;
+
+			case parser::ActControl:
+				v.onControl(c, p-begin);
+				if (counting)
+				{
+					tally.counts[Counters::Escapes]++;
+					tally.escapes[Attribute::Control]++;
+				}
+				break;
+
+			case parser::ActStart:
+				// a skipped sequence was counted when it started being skipped
+				if (counting && state != Ground && state != CsiIgnore)
+					tally.counts[Counters::SequencesAbandoned]++;
+				abandon();
+				seq.push_back(c);
+				break;
+
+			case parser::ActCollect:
+			case parser::ActDigit:
+			case parser::ActSeparator:
+			case parser::ActMarker:
+			case parser::ActIntermediate:
+				if (seq.size() >= maxSequence)
+				{
+					// an ident sequence can't be skipped to its end, since its body may contain finals
+					bool ident = (next == IdentBody);
+					abandon();
+					if (counting)
+						tally.counts[Counters::SequencesAbandoned]++;
+					next = ident ? Ground : CsiIgnore;
+					break;
+				}
+
+				seq.push_back(c);
+				if ((t >> 4) == parser::ActDigit)
+				{
+					arg = parser::addDigit(arg, c);
+					paramSeen = true;
+				}
+				else if ((t >> 4) == parser::ActSeparator)
+				{
+					paramSeen = true;
+					if (!params.push_back(arg))
+					{
+						abandon();
+						next = CsiIgnore;
+						if (counting)
+							tally.counts[Counters::SequencesAbandoned]++;
+					}
+					arg = 0;
+				}
+				else if ((t >> 4) == parser::ActMarker)
+				{
+					marker = c;
+				}
+				else if ((t >> 4) == parser::ActIntermediate)
+				{
+					intermediates = true;
+				}
+				break;
+
+			case parser::ActIgnore:
+				abandon();
+				if (counting)
+					tally.counts[Counters::SequencesAbandoned]++;
+				break;
+
+			case parser::ActEmit:
+			{
+				seq.push_back(c);
+				if (paramSeen && !params.push_back(arg))
+				{
+					abandon();
+					if (counting)
+						tally.counts[Counters::SequencesAbandoned]++;
+					break;
+				}
+
+				Attribute::Opcode op = parser::opcodes.op[*p];
+				if (state == IdentBody)
+					op = Attribute::Ident;
+				else if (intermediates || (marker != 0 && marker != '?'))
+					op = Attribute::Other;
+				else if (marker == '?')
+					op = (c == 'h') ? Attribute::SetMode : (c == 'l') ? Attribute::ResetMode : Attribute::Other;
+
+				// a sequence carried over from the last flush starts at position 0
+				size_t read = p+1-begin;
+				v.onCsi(op, seq, params.data(), params.size(), (seq.size() < read) ? read-seq.size() : 0);
+				abandon();
+				if (counting)
+				{
+					tally.counts[Counters::Escapes]++;
+					tally.escapes[op]++;
+				}
+				break;
+			}
+
+			case parser::ActAbandon:
+				// a skipped sequence was counted when it started being skipped
+				if (counting && state != CsiIgnore)
+					tally.counts[Counters::SequencesAbandoned]++;
+				abandon();
+				break;
+
+			case parser::ActUtf8:
+			{
+				// the fast path only stops at a lead byte whose character is ill-formed or cut off
+				int len = checkUtf8((const char *)p, end-p);
+				if (len > 0)
+				{
+					v.onText(string_view((const char *)p, len), p-begin);
+					p += len-1;
+				}
+				else if (len < 0)
+				{
+					seq.assign((const char *)p, -len);
+					next = Utf8Tail;
+					p = end-1;
+				}
+				else
+				{
+					// drop the well-formed start of the character with it, so that it counts once
+					// whether or not it is cut off by the end of the input
+					size_t n = 1;
+					while (p+n != end && checkUtf8((const char *)p, n+1) < 0)
+						n++;
+					p += n-1;
+					if (counting)
+						tally.counts[Counters::InvalidUtf8]++;
+				}
+				break;
+			}
+			}
+
+			state = next;
+		}
+	}
+
+	template<typename V> void EscapeStream::parse(string_view s, V &visitor)
+	{
+		parseInto(s, visitor);
+		commit();
+	}
 }
 
 #endif
\ No newline at end of file
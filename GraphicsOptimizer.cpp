@@ -0,0 +1,245 @@
+#include "GraphicsOptimizer.h"
+
+namespace unixescape
+{
+	namespace
+	{
+		size_t formatEscape(const int *params, size_t n, char *buf)
+		{
+			char *p = buf;
+			*p++ = '\033';
+			*p++ = '[';
+
+			// a lone 0 is written as ESC [ m
+			if (!(n == 1 && params[0] == 0))
+			{
+				for (size_t i = 0; i < n; i++)
+				{
+					if (i > 0)
+						*p++ = ';';
+					p += snprintf(p, 12, "%d", params[i]);
+				}
+			}
+
+			*p++ = 'm';
+			return p-buf;
+		}
+
+		size_t encodedLength(const int *params, size_t n)
+		{
+			char buf[8+12*GraphicsOptimizer::maxParams];
+			return formatEscape(params, n, buf);
+		}
+
+		/* Writes the parameters which set the color c, base being 30 for the foreground and 40 for
+		 * the background (so base+8 introduces a 256-color or RGB color and base+9 is the default),
+		 * and returns how many there are. */
+		size_t colorParams(uint32_t c, int base, int brightBase, int *params)
+		{
+			unsigned i = c & 0xff;
+			switch (Rendition::getColorKind(c))
+			{
+			case Rendition::PaletteColor:
+				if (i < 16)
+				{
+					params[0] = (i < 8) ? base+i : brightBase+i-8;
+					return 1;
+				}
+				params[0] = base+8;
+				params[1] = 5;
+				params[2] = i;
+				return 3;
+
+			case Rendition::RgbColor:
+				params[0] = base+8;
+				params[1] = 2;
+				params[2] = (c >> 16) & 0xff;
+				params[3] = (c >> 8) & 0xff;
+				params[4] = i;
+				return 5;
+
+			default:
+				params[0] = base+9;
+				return 1;
+			}
+		}
+
+		size_t setParams(const Rendition &from, const Rendition &to, unsigned char on, int *params)
+		{
+			size_t n = 0;
+
+			// Blink is set by 5 (6 is the same flag)
+			for (int p = 1; p <= 9; p++)
+			{
+				if (p != 6 && (on & Rendition::flagOn(p)) != 0)
+					params[n++] = p;
+			}
+
+			if (to.fg != from.fg)
+				n += colorParams(to.fg, 30, 90, params+n);
+			if (to.bg != from.bg)
+				n += colorParams(to.bg, 40, 100, params+n);
+			return n;
+		}
+
+		inline bool resets(const EscapeStream::Attribute &a)
+		{
+			return (a.getParamCount() == 0 || a.getParam(0) == 0);
+		}
+	}
+
+	long GraphicsOptimizer::Stats::getBytesSaved() const
+	{
+		return (long)bytesIn-(long)bytesOut;
+	}
+
+	GraphicsOptimizer::GraphicsOptimizer()
+	{
+		reset();
+		resetStats();
+	}
+
+	void GraphicsOptimizer::emit(const int *params, size_t n, AttributeText<Attribute> &out)
+	{
+		char buf[8+12*maxParams];
+		size_t len = formatEscape(params, n, buf);
+		if (n == 1 && params[0] == 0)
+			n = 0;
+
+		out.push_back(0, Attribute(Attribute::Graphics, string_view(buf, len), params, n));
+		stats.escapesOut++;
+		stats.bytesOut += len;
+	}
+
+	void GraphicsOptimizer::sync(AttributeText<Attribute> &out)
+	{
+		if (opaque || written == wanted)
+			return ;
+
+		int params[maxParams];
+		emit(params, transition(written, wanted, params), out);
+		written = wanted;
+	}
+
+	void GraphicsOptimizer::escape(const Attribute &a, AttributeText<Attribute> &out)
+	{
+		if (a.getOpcode() != Attribute::Graphics)
+		{
+			sync(out);
+			out.push_back(0, a);
+			return ;
+		}
+
+		stats.escapesIn++;
+		stats.bytesIn += a.getEscape().size();
+
+		Rendition next = wanted;
+		bool known = next.apply(a);
+		if (!opaque && known)
+		{
+			wanted = next;
+			return ;
+		}
+
+		// copy the escape unchanged, and stay unsure of the state until a known reset
+		if (!opaque)
+			sync(out);
+		out.push_back(0, a);
+		stats.escapesOut++;
+		stats.bytesOut += a.getEscape().size();
+
+		opaque = !(known && resets(a));
+		written = wanted = next;
+	}
+
+	void GraphicsOptimizer::optimize(AttributeText<Attribute> &t, AttributeText<Attribute> &out)
+	{
+		EscapeStream::visit(t, [&](string_view s)
+		{
+			sync(out);
+			out.append(s.data(), s.size());
+		}, [&](const Attribute &a)
+		{
+			escape(a, out);
+		});
+	}
+
+	void GraphicsOptimizer::optimize(AttributeRope<Attribute> &r, AttributeText<Attribute> &out)
+	{
+		r.forEachLeaf([&](AttributeText<Attribute> &t)
+		{
+			optimize(t, out);
+		});
+	}
+
+	AttributeText<GraphicsOptimizer::Attribute> GraphicsOptimizer::optimize(AttributeText<Attribute> &t)
+	{
+		AttributeText<Attribute> rtn;
+		rtn.reserve(t.size());
+		optimize(t, rtn);
+		return rtn;
+	}
+
+	void GraphicsOptimizer::finish(AttributeText<Attribute> &out)
+	{
+		sync(out);
+	}
+
+	size_t GraphicsOptimizer::transition(const Rendition &from, const Rendition &to, int *params)
+	{
+		if (from == to)
+			return 0;
+
+		// either change only what differs...
+		int changed[maxParams];
+		size_t n = 0;
+		unsigned char off = from.flags & ~to.flags;
+		unsigned char on = to.flags & ~from.flags;
+		if ((off & (Rendition::Bold | Rendition::Dim)) != 0)
+		{
+			// 22 turns off both, so whichever should stay on is turned on again
+			changed[n++] = 22;
+			on |= to.flags & (Rendition::Bold | Rendition::Dim);
+		}
+		for (int p = 23; p <= 29; p++)
+		{
+			if ((off & Rendition::flagOff(p)) != 0)
+				changed[n++] = p;
+		}
+		n += setParams(from, to, on, changed+n);
+
+		// ...or reset and set everything
+		int reset[maxParams];
+		size_t m = 0;
+		reset[m++] = 0;
+		m += setParams(Rendition(), to, to.flags, reset+m);
+
+		if (encodedLength(reset, m) < encodedLength(changed, n))
+		{
+			copy(reset, reset+m, params);
+			return m;
+		}
+		copy(changed, changed+n, params);
+		return n;
+	}
+
+	GraphicsOptimizer::Stats GraphicsOptimizer::getStats()
+	{
+		return stats;
+	}
+
+	void GraphicsOptimizer::resetStats()
+	{
+		stats.escapesIn = 0;
+		stats.escapesOut = 0;
+		stats.bytesIn = 0;
+		stats.bytesOut = 0;
+	}
+
+	void GraphicsOptimizer::reset()
+	{
+		written = Rendition();
+		wanted = Rendition();
+		opaque = false;
+	}
+}
@@ -0,0 +1,110 @@
+/* Copyright 2013 Oliver Katz
+ *
+ * This file is part of LibUNIXEscape.
+ *
+ * LibUNIXEscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LibUNIXEscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LibUNIXEscape.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file GraphicsOptimizer.h
+ *  \brief Contains GraphicsOptimizer class, which removes redundant graphics escapes.
+ *  Programs often write runs like ESC [ 0 m ESC [ 0 m ESC [ 1 m ESC [ 0 m where only the state
+ *  left at the next character matters. The optimizer follows the rendition the input asks for,
+ *  and only writes an escape when text or another escape follows and the rendition differs from
+ *  the one the output is in, choosing the shortest escape that makes the change. */
+
+#ifndef __LIB_UNIX_ESCAPE_GRAPHICS_OPTIMIZER_H
+#define __LIB_UNIX_ESCAPE_GRAPHICS_OPTIMIZER_H
+
+#include "Rendition.h"
+
+/*! Namespace for all LibUNIXEscape classes/methods/global variables. */
+namespace unixescape
+{
+	/*! Class which copies parsed text and escapes, replacing the graphics (ESC [ n m) escapes with the
+	 *  fewest bytes that give the same rendition to every character. It keeps its state from one call
+	 *  to the next, so a stream can be optimized one flush() at a time.
+	 *  \warning After a graphics escape with a parameter Rendition doesn't understand, the state of the
+	 *  terminal is unknown, so graphics escapes are copied unchanged until the next reset (ESC [ 0 m). */
+	class GraphicsOptimizer
+	{
+	public:
+		typedef EscapeStream::Attribute Attribute;
+
+		/*! Counts of the graphics escapes read and written. */
+		typedef struct Stats
+		{
+			/*! Number of graphics escapes read. */
+			size_t escapesIn;
+
+			/*! Number of graphics escapes written. */
+			size_t escapesOut;
+
+			/*! Bytes of graphics escapes read. */
+			size_t bytesIn;
+
+			/*! Bytes of graphics escapes written. */
+			size_t bytesOut;
+
+			/*! Returns the number of bytes saved (bytesIn minus bytesOut). */
+			long getBytesSaved() const;
+		} Stats;
+
+		/*! Maximum number of parameters of a transition (flags, and two RGB colors of 5 each). */
+		static const size_t maxParams = 32;
+
+	protected:
+		Rendition written;
+		Rendition wanted;
+		bool opaque;
+		Stats stats;
+
+		void emit(const int *params, size_t n, AttributeText<Attribute> &out);
+		void sync(AttributeText<Attribute> &out);
+		void escape(const Attribute &a, AttributeText<Attribute> &out);
+
+	public:
+		/*! Constructor. The output starts in the default rendition. */
+		GraphicsOptimizer();
+
+		/*! Appends \a t to \a out without its redundant graphics escapes. A change of rendition at the
+		 *  end of \a t is held back until the next call, or finish(). */
+		void optimize(AttributeText<Attribute> &t, AttributeText<Attribute> &out);
+
+		/*! Like optimize(AttributeText<Attribute> &, AttributeText<Attribute> &), for every leaf of \a r. */
+		void optimize(AttributeRope<Attribute> &r, AttributeText<Attribute> &out);
+
+		/*! Returns \a t without its redundant graphics escapes. */
+		AttributeText<Attribute> optimize(AttributeText<Attribute> &t);
+
+		/*! Appends the change of rendition held back by the last optimize() to \a out, for the end
+		 *  of a stream. */
+		void finish(AttributeText<Attribute> &out);
+
+		/*! Writes the SGR parameters of the shortest escape from rendition \a from to rendition \a to
+		 *  to \a params, which must have room for maxParams, and returns how many there are (0 if the
+		 *  renditions are the same). A single 0 stands for ESC [ m. */
+		static size_t transition(const Rendition &from, const Rendition &to, int *params);
+
+		/*! Gets the counts of graphics escapes read and written since the last resetStats(). */
+		Stats getStats();
+
+		/*! Sets the counts of graphics escapes to 0. */
+		void resetStats();
+
+		/*! Forgets the state of the stream, as if the output were back in the default rendition. */
+		void reset();
+	};
+}
+
+#endif
@@ -0,0 +1,208 @@
+#include "Log.h"
+#include <cerrno>
+#include <unistd.h>
+
+namespace unixescape
+{
+	namespace
+	{
+		atomic<AsyncLog *> current(NULL);
+
+		// calls of logMessage() and flushLog() which may be using the installed log
+		atomic<size_t> inFlight(0);
+
+		/* Counts a call as in flight while it holds the installed log, so that the log's destructor
+		 * can wait for it before freeing the ring. */
+		class InFlight
+		{
+		public:
+			InFlight() { inFlight.fetch_add(1); }
+			~InFlight() { inFlight.fetch_sub(1); }
+		};
+
+		void writeAll(int fd, const char *p, size_t n)
+		{
+			while (n > 0)
+			{
+				ssize_t w = ::write(fd, p, n);
+				if (w < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					return ;
+				}
+				p += w;
+				n -= w;
+			}
+		}
+	}
+
+	const size_t AsyncLog::slotSize;
+
+	void logMessage(const string &s)
+	{
+		InFlight f;
+		AsyncLog *l = current.load();
+		if (l != NULL)
+		{
+			l->push(s);
+			return ;
+		}
+
+		UE_MESSAGE_STREAM << s;
+	}
+
+	void flushLog()
+	{
+		InFlight f;
+		AsyncLog *l = current.load();
+		if (l != NULL)
+			l->flush();
+	}
+
+	AsyncLog::AsyncLog(int f, size_t capacity) : fd(f), tail(0), head(0), dropped(0), sleeping(false), stopping(false)
+	{
+		size_t n = 1;
+		while (n < capacity)
+			n *= 2;
+		mask = n-1;
+
+		slots = new Slot[n];
+		for (size_t i = 0; i < n; i++)
+			slots[i].seq.store(i, memory_order_relaxed);
+
+		writer = thread([this]() { run(); });
+	}
+
+	AsyncLog::~AsyncLog()
+	{
+		// once uninstalled, no new call can reach the log, and the ones which already had it finish
+		AsyncLog *self = this;
+		if (current.compare_exchange_strong(self, NULL))
+		{
+			while (inFlight.load() != 0)
+				this_thread::yield();
+		}
+
+		{
+			lock_guard<mutex> l(lock);
+			stopping = true;
+		}
+		wake.notify_one();
+		writer.join();
+		delete [] slots;
+	}
+
+	bool AsyncLog::push(string_view s)
+	{
+		// claim the slot at the tail once the writer has freed it (its sequence is the position)
+		size_t pos = tail.load(memory_order_relaxed);
+		Slot *slot;
+		while (true)
+		{
+			slot = &slots[pos & mask];
+			size_t seq = slot->seq.load(memory_order_acquire);
+			intptr_t diff = (intptr_t)seq-(intptr_t)pos;
+			if (diff == 0)
+			{
+				if (tail.compare_exchange_weak(pos, pos+1, memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				dropped.fetch_add(1, memory_order_relaxed);
+				return false;
+			}
+			else
+			{
+				pos = tail.load(memory_order_relaxed);
+			}
+		}
+
+		slot->length = min(s.size(), slotSize);
+		memcpy(slot->text, s.data(), slot->length);
+		slot->seq.store(pos+1);
+
+		// the writer only sleeps on an empty ring, so it only needs waking for the first message
+		if (sleeping.load())
+		{
+			lock_guard<mutex> l(lock);
+			wake.notify_one();
+		}
+		return true;
+	}
+
+	size_t AsyncLog::drain(string &batch)
+	{
+		// take the filled slots in order, and give each back for the next lap of the ring
+		size_t pos = head.load(memory_order_relaxed), n = 0;
+		while (true)
+		{
+			Slot &slot = slots[pos & mask];
+			if (slot.seq.load(memory_order_acquire) != pos+1)
+				break;
+
+			batch.append(slot.text, slot.length);
+			slot.seq.store(pos+mask+1, memory_order_release);
+			pos++;
+			n++;
+		}
+		return n;
+	}
+
+	bool AsyncLog::ready()
+	{
+		size_t pos = head.load(memory_order_relaxed);
+		return (slots[pos & mask].seq.load() == pos+1);
+	}
+
+	void AsyncLog::run()
+	{
+		string batch;
+		while (true)
+		{
+			batch.clear();
+			size_t n = drain(batch);
+			if (n > 0)
+			{
+				// published after the write, so that flush() returns once the messages are out
+				writeAll(fd, batch.data(), batch.size());
+				{
+					lock_guard<mutex> l(lock);
+					head.store(head.load(memory_order_relaxed)+n, memory_order_release);
+				}
+				written.notify_all();
+				continue;
+			}
+
+			unique_lock<mutex> l(lock);
+			if (stopping)
+				break;
+			sleeping.store(true);
+			wake.wait(l, [&]() { return (stopping || ready()); });
+			sleeping.store(false);
+		}
+	}
+
+	void AsyncLog::flush()
+	{
+		size_t end = tail.load(memory_order_acquire);
+		unique_lock<mutex> l(lock);
+		written.wait(l, [&]() { return (head.load(memory_order_relaxed) >= end); });
+	}
+
+	size_t AsyncLog::getDropped()
+	{
+		return dropped.load(memory_order_relaxed);
+	}
+
+	void AsyncLog::install(AsyncLog *l)
+	{
+		current.store(l, memory_order_release);
+	}
+
+	AsyncLog *AsyncLog::installed()
+	{
+		return current.load(memory_order_acquire);
+	}
+}
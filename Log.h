@@ -0,0 +1,105 @@
+/* Copyright 2013 Oliver Katz
+ *
+ * This file is part of LibUNIXEscape.
+ *
+ * LibUNIXEscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LibUNIXEscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LibUNIXEscape.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file Log.h
+ *  \brief Contains AsyncLog class, a log sink which writes messages on its own thread.
+ *  Once installed, the UE_ERROR, UE_WARNING, UE_DEBUG and UE_TRACE macros only copy their message
+ *  into a ring buffer, so the thread which logs never waits for the terminal or file. */
+
+#ifndef __LIB_UNIX_ESCAPE_LOG_H
+#define __LIB_UNIX_ESCAPE_LOG_H
+
+#include "Util.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/*! Namespace for all LibUNIXEscape classes/methods/global variables. */
+namespace unixescape
+{
+	/*! Asynchronous log sink. Messages are copied into a fixed ring of slots by any number of
+	 *  threads without locking (a bounded queue in the style of Dmitry Vyukov's, where each slot's
+	 *  sequence number says whose turn it is), and a writer thread writes them to a file descriptor
+	 *  in batches.
+	 *  \warning A message is dropped, and counted by getDropped(), when the ring is full, and
+	 *  truncated to slotSize bytes. Messages written by UE_FATAL or UE_MESSAGE_DISPLAY bypass the
+	 *  sink. */
+	class AsyncLog
+	{
+	public:
+		/*! Maximum length of a message, including its newline. */
+		static const size_t slotSize = 496;
+
+	protected:
+		typedef struct Slot
+		{
+			atomic<size_t> seq;
+			size_t length;
+			char text[slotSize];
+		} Slot;
+
+		Slot *slots;
+		size_t mask;
+		int fd;
+		alignas(64) atomic<size_t> tail;
+		alignas(64) atomic<size_t> head;
+		atomic<size_t> dropped;
+		atomic<bool> sleeping;
+
+		mutex lock;
+		condition_variable wake;
+		condition_variable written;
+		bool stopping;
+		thread writer;
+
+		bool ready();
+		void run();
+		size_t drain(string &batch);
+
+	public:
+		/*! Constructor. Starts a writer thread which writes to \a fd, through a ring of \a capacity
+		 *  slots (rounded up to a power of two). */
+		AsyncLog(int fd = 1, size_t capacity = 1024);
+
+		/*! Destructor. Uninstalls the log if it is installed, waits for the UE_* macros which were
+		 *  already using it, writes the messages left and stops the writer thread. */
+		~AsyncLog();
+
+		AsyncLog(const AsyncLog &l) = delete;
+		AsyncLog &operator = (const AsyncLog &l) = delete;
+
+		/*! Queues the message \a s. Returns false if the ring is full and the message was dropped. */
+		bool push(string_view s);
+
+		/*! Waits until every message queued before the call has been written. */
+		void flush();
+
+		/*! Returns the number of messages dropped because the ring was full. */
+		size_t getDropped();
+
+		/*! Sends the messages of the UE_* macros to \a l, or back to UE_MESSAGE_STREAM if \a l is NULL.
+		 *  \warning \a l must stay alive until it is uninstalled (its destructor does that). */
+		static void install(AsyncLog *l);
+
+		/*! Returns the installed log, or NULL. */
+		static AsyncLog *installed();
+	};
+}
+
+#endif
@@ -0,0 +1,164 @@
+#include "Rendition.h"
+
+namespace unixescape
+{
+	bool Rendition::apply(const EscapeStream::Attribute &a)
+	{
+		if (a.getOpcode() != EscapeStream::Attribute::Graphics)
+			return true;
+
+		// no parameters means 0
+		if (a.getParamCount() == 0)
+			return applyParam(0);
+
+		bool known = true;
+		for (size_t i = 0; i < a.getParamCount(); i++)
+		{
+			int p = a.getParam(i);
+
+			// a parameter with sub-parameters (4:3, 38:2::r:g:b) is applied as one group
+			size_t subs = 0;
+			while (a.hasSubParams() && a.isSubParam(i+1+subs))
+				subs++;
+			if (subs > 0)
+			{
+				int sub[maxGroup];
+				for (size_t k = 0; k < subs && k < maxGroup; k++)
+					sub[k] = a.getParam(i+1+k);
+				known = applyGroup(p, sub, (subs < maxGroup) ? subs : maxGroup) && known;
+				i += subs;
+				continue;
+			}
+
+			if (p == 38 || p == 48 || p == 58)
+			{
+				// 256-color and RGB colors take the parameters after them as arguments
+				size_t n = (a.getParam(i+1) == 2) ? 4 : (a.getParam(i+1) == 5) ? 2 : 0;
+				int args[4];
+				for (size_t k = 0; k < n; k++)
+					args[k] = a.getParam(i+1+k);
+				known = (i+n < a.getParamCount()) && applyColor(p, args, n) && known;
+				i += n;
+				continue;
+			}
+			known = applyParam(p) && known;
+		}
+		return known;
+	}
+
+	bool Rendition::applyParam(int p)
+	{
+		if (p >= 30 && p <= 37)
+			fg = paletteColor(p-30);
+		else if (p >= 90 && p <= 97)
+			fg = paletteColor(p-90+8);
+		else if (p >= 40 && p <= 47)
+			bg = paletteColor(p-40);
+		else if (p >= 100 && p <= 107)
+			bg = paletteColor(p-100+8);
+		else if (p == 0)
+			*this = Rendition();
+		else if (p == 22)
+			flags &= ~(Bold | Dim);
+		else if (p == 39)
+			fg = defaultColor;
+		else if (p == 49)
+			bg = defaultColor;
+		else if (flagOn(p) != 0)
+			flags |= flagOn(p);
+		else if (flagOff(p) != 0)
+			flags &= ~flagOff(p);
+		else
+			return false;
+		return true;
+	}
+
+	bool Rendition::applyGroup(int p, const int *sub, size_t n)
+	{
+		// 4:0 and 4:1 are plain underline off and on; other underline styles are drawn as a
+		// plain underline, but reported as not understood so that they are kept as written
+		if (p == 4)
+		{
+			if (sub[0] == 0)
+				flags &= ~Underline;
+			else
+				flags |= Underline;
+			return (sub[0] <= 1);
+		}
+
+		if (p == 38 || p == 48 || p == 58)
+			return applyColor(p, sub, n);
+		return false;
+	}
+
+	bool Rendition::applyColor(int p, const int *args, size_t n)
+	{
+		uint32_t c;
+		if (n == 2 && args[0] == 5 && args[1] >= 0 && args[1] <= 255)
+		{
+			c = paletteColor(args[1]);
+		}
+		else if ((n == 4 || n == 5) && args[0] == 2)
+		{
+			// the components are the last three arguments, after the color space id if there is one
+			const int *v = args+n-3;
+			for (int k = 0; k < 3; k++)
+				if (v[k] < 0 || v[k] > 255)
+					return false;
+			c = rgbColor(v[0], v[1], v[2]);
+		}
+		else
+		{
+			return false;
+		}
+
+		if (p == 38)
+			fg = c;
+		else if (p == 48)
+			bg = c;
+		else
+			return false;
+		return true;
+	}
+
+	unsigned char Rendition::flagOn(int p)
+	{
+		switch (p)
+		{
+		case 1: return Bold;
+		case 2: return Dim;
+		case 3: return Italic;
+		case 4: return Underline;
+		case 5: return Blink;
+		case 6: return Blink;
+		case 7: return Inverse;
+		case 8: return Hidden;
+		case 9: return Strike;
+		default: return 0;
+		}
+	}
+
+	unsigned char Rendition::flagOff(int p)
+	{
+		switch (p)
+		{
+		case 23: return Italic;
+		case 24: return Underline;
+		case 25: return Blink;
+		case 27: return Inverse;
+		case 28: return Hidden;
+		case 29: return Strike;
+		default: return 0;
+		}
+	}
+
+	bool Rendition::operator == (const Rendition &r) const
+	{
+		return (flags == r.flags && fg == r.fg && bg == r.bg);
+	}
+
+	bool Rendition::operator != (const Rendition &r) const
+	{
+		return !(*this == r);
+	}
+}
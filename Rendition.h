@@ -0,0 +1,116 @@
+/* Copyright 2013 Oliver Katz
+ *
+ * This file is part of LibUNIXEscape.
+ *
+ * LibUNIXEscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LibUNIXEscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LibUNIXEscape.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file Rendition.h
+ *  \brief Contains Rendition, the graphic rendition state changed by ESC [ n m escapes. */
+
+#ifndef __LIB_UNIX_ESCAPE_RENDITION_H
+#define __LIB_UNIX_ESCAPE_RENDITION_H
+
+#include "EscapeStream.h"
+
+/*! Namespace for all LibUNIXEscape classes/methods/global variables. */
+namespace unixescape
+{
+	/*! Graphic rendition set by ESC [ n m escapes: text style flags and colors. */
+	typedef struct Rendition
+	{
+		/*! The text style flags. */
+		typedef enum Flag : unsigned char
+		{
+			Bold = 1 << 0,
+			Dim = 1 << 1,
+			Italic = 1 << 2,
+			Underline = 1 << 3,
+			Blink = 1 << 4,
+			Inverse = 1 << 5,
+			Hidden = 1 << 6,
+			Strike = 1 << 7
+		} Flag;
+
+		/*! The kinds of colors, kept in the top byte of a color. */
+		typedef enum ColorKind : unsigned char
+		{
+			/*! The terminal's own color. */
+			DefaultColor,
+			/*! One of the 256 colors of the palette, its index in the low byte (0 to 7 are set by
+			 *  30 to 37, 8 to 15 by 90 to 97, and all of them by 38;5;n). */
+			PaletteColor,
+			/*! A direct color, red, green and blue in the low three bytes (set by 38;2;r;g;b). */
+			RgbColor
+		} ColorKind;
+
+		/*! Largest number of sub-parameters of one parameter which are read. */
+		static const size_t maxGroup = 8;
+
+		/*! The color used when none has been set. */
+		static const uint32_t defaultColor = 0;
+
+		/*! The text style, a combination of Flag values. */
+		unsigned char flags;
+
+		/*! The foreground color: defaultColor, a paletteColor() or an rgbColor(). */
+		uint32_t fg;
+
+		/*! The background color, as for fg. */
+		uint32_t bg;
+
+		/*! Constructor. */
+		Rendition() : flags(0), fg(defaultColor), bg(defaultColor) {}
+
+		/*! Returns the color with index \a i (0 to 255) in the palette. */
+		static uint32_t paletteColor(unsigned i) { return ((uint32_t)PaletteColor << 24) | (i & 0xff); }
+
+		/*! Returns the direct color with the components \a r, \a g and \a b (0 to 255). */
+		static uint32_t rgbColor(unsigned r, unsigned g, unsigned b) { return ((uint32_t)RgbColor << 24) | ((r & 0xff) << 16) | ((g & 0xff) << 8) | (b & 0xff); }
+
+		/*! Returns the kind of the color \a c. */
+		static ColorKind getColorKind(uint32_t c) { return (ColorKind)(c >> 24); }
+
+		/*! Applies the graphics escape \a a. Other kinds of escapes are ignored. Returns false if
+		 *  some of the parameters were not understood (and so were ignored). */
+		bool apply(const EscapeStream::Attribute &a);
+
+		/*! Applies the SGR parameter \a p. Returns false if it was not understood. */
+		bool applyParam(int p);
+
+		/*! Applies the SGR parameter \a p followed by the \a n sub-parameters \a sub (as in 4:3 or
+		 *  38:2::r:g:b). Returns false if it was not understood. */
+		bool applyGroup(int p, const int *sub, size_t n);
+
+		/*! Applies the color parameter \a p (38, 48 or 58) with its \a n arguments \a args: 5 and
+		 *  an index, or 2 and the red, green and blue components, which may follow a color space id.
+		 *  Returns false if it was not understood; the underline color of 58 is not kept. */
+		bool applyColor(int p, const int *args, size_t n);
+
+		/*! Returns the flag the SGR parameter \a p turns on, or 0. */
+		static unsigned char flagOn(int p);
+
+		/*! Returns the flag the SGR parameter \a p turns off, or 0 (22, which turns off both Bold
+		 *  and Dim, is not included). */
+		static unsigned char flagOff(int p);
+
+		/*! Comparison operator. */
+		bool operator == (const Rendition &r) const;
+
+		/*! Comparison operator. */
+		bool operator != (const Rendition &r) const;
+	} Rendition;
+}
+
+#endif
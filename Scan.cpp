@@ -0,0 +1,523 @@
+#include "Scan.h"
+#include "Utf8.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define UE_SCAN_X86
+#endif
+
+namespace unixescape
+{
+	namespace
+	{
+		typedef size_t (*ScanFunction)(const char *, size_t);
+		typedef size_t (*FindFunction)(const char *, size_t, const char *, size_t);
+
+		const size_t npos = std::string::npos;
+
+		inline bool isPrintableByte(unsigned char c)
+		{
+			return (unsigned char)(c-0x20) < 0x5f;
+		}
+
+		size_t scanPrintableScalar(const char *s, size_t n)
+		{
+			const unsigned char *p = (const unsigned char *)s;
+			size_t i = 0;
+			while (i < n && isPrintableByte(p[i]))
+				i++;
+			return i;
+		}
+
+		size_t scanUnescapedScalar(const char *s, size_t n)
+		{
+			const unsigned char *p = (const unsigned char *)s;
+			size_t i = 0;
+			while (i < n && isPrintableByte(p[i]) && p[i] != '\\')
+				i++;
+			return i;
+		}
+
+		size_t scanTextScalar(const char *s, size_t n)
+		{
+			const unsigned char *p = (const unsigned char *)s;
+			size_t i = 0;
+			while (i < n)
+			{
+				if (isPrintableByte(p[i]))
+				{
+					i++;
+					continue;
+				}
+				if (p[i] < 0x80)
+					break;
+
+				int len = checkUtf8(s+i, n-i);
+				if (len <= 0)
+					break;
+				i += len;
+			}
+			return i;
+		}
+
+		size_t scanFindScalar(const char *s, size_t n, const char *needle, size_t m)
+		{
+			if (n < m)
+				return npos;
+
+			const char *p = s;
+			const char *end = s+n-m+1;
+			while (p < end)
+			{
+				p = (const char *)memchr(p, needle[0], end-p);
+				if (p == NULL)
+					return npos;
+				if (memcmp(p+1, needle+1, m-1) == 0)
+					return p-s;
+				p++;
+			}
+			return npos;
+		}
+
+#ifdef UE_SCAN_X86
+		/* Adding 0x60 maps the printable bytes 0x20-0x7e onto the signed range -128 to -34,
+		 * and every other byte above it, so one signed compare finds the non-printable bytes. */
+
+		__attribute__((target("sse2"))) size_t scanPrintableSSE2(const char *s, size_t n)
+		{
+			const __m128i bias = _mm_set1_epi8(0x60);
+			const __m128i limit = _mm_set1_epi8(-34);
+			size_t i = 0;
+
+			for (; i+16 <= n; i += 16)
+			{
+				__m128i v = _mm_loadu_si128((const __m128i *)(s+i));
+				int mask = _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_add_epi8(v, bias), limit));
+				if (mask != 0)
+					return i+__builtin_ctz(mask);
+			}
+
+			return i+scanPrintableScalar(s+i, n-i);
+		}
+
+		__attribute__((target("sse2"))) size_t scanUnescapedSSE2(const char *s, size_t n)
+		{
+			const __m128i bias = _mm_set1_epi8(0x60);
+			const __m128i limit = _mm_set1_epi8(-34);
+			const __m128i backslash = _mm_set1_epi8('\\');
+			size_t i = 0;
+
+			for (; i+16 <= n; i += 16)
+			{
+				__m128i v = _mm_loadu_si128((const __m128i *)(s+i));
+				__m128i stop = _mm_or_si128(_mm_cmpgt_epi8(_mm_add_epi8(v, bias), limit), _mm_cmpeq_epi8(v, backslash));
+				int mask = _mm_movemask_epi8(stop);
+				if (mask != 0)
+					return i+__builtin_ctz(mask);
+			}
+
+			return i+scanUnescapedScalar(s+i, n-i);
+		}
+
+		__attribute__((target("sse2"))) size_t scanTextSSE2(const char *s, size_t n)
+		{
+			const __m128i bias = _mm_set1_epi8(0x60);
+			const __m128i limit = _mm_set1_epi8(-34);
+			size_t i = 0;
+
+			// skip printable vectors, and check each non-ASCII sequence where one stops
+			while (i+16 <= n)
+			{
+				__m128i v = _mm_loadu_si128((const __m128i *)(s+i));
+				int mask = _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_add_epi8(v, bias), limit));
+				if (mask == 0)
+				{
+					i += 16;
+					continue;
+				}
+
+				i += __builtin_ctz(mask);
+				if ((unsigned char)s[i] < 0x80)
+					return i;
+
+				int len = checkUtf8(s+i, n-i);
+				if (len <= 0)
+					return i;
+				i += len;
+			}
+
+			return i+scanTextScalar(s+i, n-i);
+		}
+
+		__attribute__((target("sse2"))) size_t scanFindSSE2(const char *s, size_t n, const char *needle, size_t m)
+		{
+			const __m128i first = _mm_set1_epi8(needle[0]);
+			const __m128i last = _mm_set1_epi8(needle[m-1]);
+			size_t i = 0;
+
+			for (; i+m-1+16 <= n; i += 16)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i *)(s+i));
+				__m128i b = _mm_loadu_si128((const __m128i *)(s+i+m-1));
+				unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+				while (mask != 0)
+				{
+					size_t j = i+__builtin_ctz(mask);
+					if (memcmp(s+j+1, needle+1, m-2) == 0)
+						return j;
+					mask &= mask-1;
+				}
+			}
+
+			size_t r = scanFindScalar(s+i, n-i, needle, m);
+			return (r == npos) ? npos : i+r;
+		}
+
+		__attribute__((target("avx2"))) size_t scanPrintableAVX2(const char *s, size_t n)
+		{
+			const __m256i bias = _mm256_set1_epi8(0x60);
+			const __m256i limit = _mm256_set1_epi8(-34);
+			size_t i = 0;
+
+			for (; i+32 <= n; i += 32)
+			{
+				__m256i v = _mm256_loadu_si256((const __m256i *)(s+i));
+				unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_add_epi8(v, bias), limit));
+				if (mask != 0)
+					return i+__builtin_ctz(mask);
+			}
+
+			return i+scanPrintableSSE2(s+i, n-i);
+		}
+
+		__attribute__((target("avx2"))) size_t scanUnescapedAVX2(const char *s, size_t n)
+		{
+			const __m256i bias = _mm256_set1_epi8(0x60);
+			const __m256i limit = _mm256_set1_epi8(-34);
+			const __m256i backslash = _mm256_set1_epi8('\\');
+			size_t i = 0;
+
+			for (; i+32 <= n; i += 32)
+			{
+				__m256i v = _mm256_loadu_si256((const __m256i *)(s+i));
+				__m256i stop = _mm256_or_si256(_mm256_cmpgt_epi8(_mm256_add_epi8(v, bias), limit), _mm256_cmpeq_epi8(v, backslash));
+				unsigned mask = (unsigned)_mm256_movemask_epi8(stop);
+				if (mask != 0)
+					return i+__builtin_ctz(mask);
+			}
+
+			return i+scanUnescapedSSE2(s+i, n-i);
+		}
+
+		/* The UTF-8 validation of "Validating UTF-8 In Less Than One Instruction Per Byte" (Keiser
+		 * and Lemire, 2021): the high nibble of the previous byte and both nibbles of the current
+		 * one each select a set of error bits from a 16-entry table, and a byte is in error if a bit
+		 * is set in all three. Continuations required by three and four byte leads are checked by
+		 * comparing the bytes two and three back. */
+
+		enum Utf8Error
+		{
+			TooShort = 1 << 0,   // a lead or ASCII byte where a continuation should be
+			TooLong = 1 << 1,    // a continuation after ASCII
+			Overlong3 = 1 << 2,  // E0 followed by 80-9F
+			TooLarge = 1 << 3,   // above U+10FFFF
+			Surrogate = 1 << 4,  // ED followed by A0-BF
+			Overlong2 = 1 << 5,  // C0 or C1
+			TooLarge1000 = 1 << 6,
+			Overlong4 = 1 << 6,  // F0 followed by 80-8F
+			TwoConts = 1 << 7,   // a continuation after a continuation
+			Carry = TooShort | TooLong | TwoConts
+		};
+
+		__attribute__((target("avx2"))) inline __m256i lookup16(__m256i idx, char a0, char a1, char a2, char a3,
+			char a4, char a5, char a6, char a7, char a8, char a9, char a10, char a11, char a12, char a13, char a14, char a15)
+		{
+			__m256i table = _mm256_setr_epi8(a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15,
+				a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15);
+			return _mm256_shuffle_epi8(table, idx);
+		}
+
+		__attribute__((target("avx2"))) inline __m256i high4(__m256i v)
+		{
+			return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f));
+		}
+
+		/* Returns \a v shifted up by \a N bytes, with the last bytes of \a prev shifted in. */
+		template<int N> __attribute__((target("avx2"))) inline __m256i previous(__m256i v, __m256i prev)
+		{
+			return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(prev, v, 0x21), 16-N);
+		}
+
+		__attribute__((target("avx2"))) __m256i utf8Errors(__m256i v, __m256i prev)
+		{
+			__m256i prev1 = previous<1>(v, prev);
+			__m256i byte1High = lookup16(high4(prev1),
+				TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong,
+				TwoConts, TwoConts, TwoConts, TwoConts,
+				TooShort | Overlong2,
+				TooShort,
+				TooShort | Overlong3 | Surrogate,
+				TooShort | TooLarge | TooLarge1000 | Overlong4);
+			__m256i byte1Low = lookup16(_mm256_and_si256(prev1, _mm256_set1_epi8(0x0f)),
+				Carry | Overlong3 | Overlong2 | Overlong4,
+				Carry | Overlong2,
+				Carry,
+				Carry,
+				Carry | TooLarge,
+				Carry | TooLarge | TooLarge1000,
+				Carry | TooLarge | TooLarge1000,
+				Carry | TooLarge | TooLarge1000,
+				Carry | TooLarge | TooLarge1000,
+				Carry | TooLarge | TooLarge1000,
+				Carry | TooLarge | TooLarge1000,
+				Carry | TooLarge | TooLarge1000,
+				Carry | TooLarge | TooLarge1000,
+				Carry | TooLarge | TooLarge1000 | Surrogate,
+				Carry | TooLarge | TooLarge1000,
+				Carry | TooLarge | TooLarge1000);
+			__m256i byte2High = lookup16(high4(v),
+				TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort,
+				(char)(TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge1000 | Overlong4),
+				(char)(TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge),
+				(char)(TooLong | Overlong2 | TwoConts | Surrogate | TooLarge),
+				(char)(TooLong | Overlong2 | TwoConts | Surrogate | TooLarge),
+				TooShort, TooShort, TooShort, TooShort);
+			__m256i special = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);
+
+			// a byte two after E0-FF or three after F0-FF must be a continuation: the bytes where one
+			// is needed get their high bit set, which cancels the TwoConts bit found there
+			__m256i third = _mm256_subs_epu8(previous<2>(v, prev), _mm256_set1_epi8(0xe0-0x80));
+			__m256i fourth = _mm256_subs_epu8(previous<3>(v, prev), _mm256_set1_epi8(0xf0-0x80));
+			__m256i needed = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+			return _mm256_xor_si256(needed, special);
+		}
+
+		__attribute__((target("avx2"))) size_t scanTextAVX2(const char *s, size_t n)
+		{
+			const __m256i bias = _mm256_set1_epi8(0x60);
+			const __m256i limit = _mm256_set1_epi8(-34);
+			__m256i prev = _mm256_setzero_si256();
+			bool ascii = true;
+			size_t i = 0;
+
+			for (; i+32 <= n; i += 32)
+			{
+				__m256i v = _mm256_loadu_si256((const __m256i *)(s+i));
+				unsigned other = (unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_add_epi8(v, bias), limit));
+				if (other == 0 && ascii)
+					continue;
+
+				unsigned high = (unsigned)_mm256_movemask_epi8(v);
+				if (high == 0 && ascii)
+					return i+__builtin_ctz(other);
+
+				// control bytes, or bytes which aren't UTF-8, end the run somewhere in this vector or the
+				// sequence before it, which the SSE2 scanner finds exactly
+				__m256i errors = utf8Errors(v, prev);
+				if ((other & ~high) != 0 || !_mm256_testz_si256(errors, errors))
+					break;
+
+				prev = v;
+				ascii = (high == 0);
+			}
+
+			// restart at the lead byte of a sequence which may continue here
+			size_t start = i;
+			for (size_t k = 1; k <= 3 && k <= i; k++)
+			{
+				unsigned char c = s[i-k];
+				if (c >= 0xc0)
+				{
+					start = i-k;
+					break;
+				}
+				if (c < 0x80)
+					break;
+			}
+
+			return start+scanTextSSE2(s+start, n-start);
+		}
+
+		__attribute__((target("avx2"))) size_t scanFindAVX2(const char *s, size_t n, const char *needle, size_t m)
+		{
+			const __m256i first = _mm256_set1_epi8(needle[0]);
+			const __m256i last = _mm256_set1_epi8(needle[m-1]);
+			size_t i = 0;
+
+			for (; i+m-1+32 <= n; i += 32)
+			{
+				__m256i a = _mm256_loadu_si256((const __m256i *)(s+i));
+				__m256i b = _mm256_loadu_si256((const __m256i *)(s+i+m-1));
+				unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+				while (mask != 0)
+				{
+					size_t j = i+__builtin_ctz(mask);
+					if (memcmp(s+j+1, needle+1, m-2) == 0)
+						return j;
+					mask &= mask-1;
+				}
+			}
+
+			size_t r = scanFindSSE2(s+i, n-i, needle, m);
+			return (r == npos) ? npos : i+r;
+		}
+#endif
+
+		struct Implementation
+		{
+			const char *name;
+			ScanFunction printable;
+			ScanFunction unescaped;
+			ScanFunction text;
+			FindFunction find;
+
+			Implementation()
+			{
+#ifdef UE_SCAN_X86
+				__builtin_cpu_init();
+				if (__builtin_cpu_supports("avx2"))
+				{
+					name = "avx2";
+					printable = scanPrintableAVX2;
+					unescaped = scanUnescapedAVX2;
+					text = scanTextAVX2;
+					find = scanFindAVX2;
+				}
+				else if (__builtin_cpu_supports("sse2"))
+				{
+					name = "sse2";
+					printable = scanPrintableSSE2;
+					unescaped = scanUnescapedSSE2;
+					text = scanTextSSE2;
+					find = scanFindSSE2;
+				}
+				else
+				{
+					name = "scalar";
+					printable = scanPrintableScalar;
+					unescaped = scanUnescapedScalar;
+					text = scanTextScalar;
+					find = scanFindScalar;
+				}
+#else
+				name = "scalar";
+				printable = scanPrintableScalar;
+				unescaped = scanUnescapedScalar;
+				text = scanTextScalar;
+				find = scanFindScalar;
+#endif
+			}
+		};
+
+		const Implementation &implementation()
+		{
+			static Implementation impl;
+			return impl;
+		}
+	}
+
+	size_t scanPrintable(const char *s, size_t n)
+	{
+		return implementation().printable(s, n);
+	}
+
+	size_t scanUnescaped(const char *s, size_t n)
+	{
+		return implementation().unescaped(s, n);
+	}
+
+	size_t scanText(const char *s, size_t n)
+	{
+		return implementation().text(s, n);
+	}
+
+	size_t scanFind(const char *s, size_t n, const char *needle, size_t m)
+	{
+		if (m == 0)
+			return 0;
+		if (m > n)
+			return npos;
+		if (m == 1)
+		{
+			const char *p = (const char *)memchr(s, needle[0], n);
+			return (p == NULL) ? npos : p-s;
+		}
+		return implementation().find(s, n, needle, m);
+	}
+
+	size_t scanRfind(const char *s, size_t n, const char *needle, size_t m)
+	{
+		if (m == 0)
+			return n;
+		if (m > n)
+			return npos;
+
+		size_t k = n-m+1;
+		while (k > 0)
+		{
+			const char *p = (const char *)memrchr(s, needle[0], k);
+			if (p == NULL)
+				return npos;
+			if (memcmp(p+1, needle+1, m-1) == 0)
+				return p-s;
+			k = p-s;
+		}
+		return npos;
+	}
+
+	const char *scanImplementation()
+	{
+		return implementation().name;
+	}
+
+	Searcher::Searcher(std::string_view n) : needle(n)
+	{
+		// skip table for searching backwards: how far the window can move left when its first
+		// byte is b, which is the distance from the start to the first b after the first byte
+		size_t m = needle.size();
+		for (size_t i = 0; i < 256; i++)
+			skip[i] = m;
+		for (size_t i = m; i > 1; i--)
+			skip[(unsigned char)needle[i-1]] = i-1;
+	}
+
+	std::string_view Searcher::getNeedle() const
+	{
+		return needle;
+	}
+
+	size_t Searcher::find(std::string_view s, size_t pos) const
+	{
+		if (pos > s.size())
+			return npos;
+
+		size_t r = scanFind(s.data()+pos, s.size()-pos, needle.data(), needle.size());
+		return (r == npos) ? npos : pos+r;
+	}
+
+	size_t Searcher::rfind(std::string_view s, size_t pos) const
+	{
+		size_t m = needle.size();
+		if (m > s.size())
+			return npos;
+
+		size_t i = s.size()-m;
+		if (pos < i)
+			i = pos;
+		if (m == 0)
+			return i;
+
+		const char *p = s.data();
+		while (true)
+		{
+			if (p[i] == needle[0] && memcmp(p+i+1, needle.data()+1, m-1) == 0)
+				return i;
+
+			size_t d = skip[(unsigned char)p[i]];
+			if (d > i)
+				return npos;
+			i -= d;
+		}
+	}
+}
@@ -0,0 +1,90 @@
+/* Copyright 2013 Oliver Katz
+ *
+ * This file is part of LibUNIXEscape.
+ *
+ * LibUNIXEscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * LibUNIXEscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with LibUNIXEscape.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file Scan.h
+ *  \brief Vectorized byte scanning used by the parser's fast paths.
+ *  Each scanner has an AVX2, an SSE2 and a scalar implementation, and the best one supported
+ *  by the CPU is selected the first time it is called. */
+
+#ifndef __LIB_UNIX_ESCAPE_SCAN_H
+#define __LIB_UNIX_ESCAPE_SCAN_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/*! Namespace for all LibUNIXEscape classes/methods/global variables. */
+namespace unixescape
+{
+	/*! Returns the length of the run of printable ASCII bytes (0x20 to 0x7e) at the start of
+	 *  \a s, which is \a n if all \a n bytes are printable. */
+	size_t scanPrintable(const char *s, size_t n);
+
+	/*! Returns the length of the run of printable ASCII bytes other than backslash at the start of
+	 *  \a s: the bytes makeCharsPrintable() copies unchanged. */
+	size_t scanUnescaped(const char *s, size_t n);
+
+	/*! Returns the length of the run of text at the start of \a s: printable ASCII bytes and
+	 *  complete, well-formed UTF-8 sequences. The run ends before the first control byte, ill-formed
+	 *  byte or sequence cut off by the end of \a s. The AVX2 implementation validates whole vectors of
+	 *  UTF-8 at once with the lookup tables of Keiser and Lemire, and pure ASCII vectors cost the same
+	 *  as in scanPrintable(). */
+	size_t scanText(const char *s, size_t n);
+
+	/*! Returns the position of the first occurrence of \a needle (of length \a m) in \a s, or
+	 *  std::string::npos. Candidates are found by comparing the needle's first and last bytes against
+	 *  a whole vector of positions at once, then checked with memcmp(). */
+	size_t scanFind(const char *s, size_t n, const char *needle, size_t m);
+
+	/*! Returns the position of the last occurrence of \a needle (of length \a m) lying wholly in
+	 *  \a s, or std::string::npos. Candidates are found with memrchr() on the needle's first byte,
+	 *  then checked with memcmp(), so nothing has to be prepared for a one-off search. */
+	size_t scanRfind(const char *s, size_t n, const char *needle, size_t m);
+
+	/*! Returns the name of the implementation selected for the scanners ("avx2", "sse2" or "scalar"). */
+	const char *scanImplementation();
+
+	/*! A needle prepared for repeated searches. Construct it once and pass it to find()/rfind() (or to
+	 *  AttributeText::find()) as many times as needed.
+	 *  Forward searches use scanFind() (memchr() for one-byte needles), backward searches use
+	 *  Horspool's algorithm with the skip table computed by the constructor, which pays off over
+	 *  scanRfind() for long needles searched many times. */
+	class Searcher
+	{
+	protected:
+		std::string needle;
+		size_t skip[256];
+
+	public:
+		/*! Constructor. */
+		Searcher(std::string_view n);
+
+		/*! Returns the needle. */
+		std::string_view getNeedle() const;
+
+		/*! Returns the position of the first occurrence of the needle in \a s at or after \a pos,
+		 *  or std::string::npos. */
+		size_t find(std::string_view s, size_t pos = 0) const;
+
+		/*! Returns the position of the last occurrence of the needle in \a s starting at or before
+		 *  \a pos, or std::string::npos. */
+		size_t rfind(std::string_view s, size_t pos = std::string::npos) const;
+	};
+}
+
+#endif
@@ -0,0 +1,513 @@
+#include "Screen.h"
+#include "Utf8.h"
+
+namespace unixescape
+{
+	namespace
+	{
+		const size_t tabWidth = 8;
+
+		inline long repeat(const EscapeStream::Attribute &a)
+		{
+			// a missing or zero count means one
+			return max(a.getParam(0), 1);
+		}
+	}
+
+	Screen::Screen(size_t r, size_t c, size_t scrollback) : rows(max(r, (size_t)1)), cols(max(c, (size_t)1)), historyCapacity(scrollback)
+	{
+		reset();
+	}
+
+	Screen::Cell Screen::blank()
+	{
+		// erased cells keep the background color, as on most terminals
+		Cell b;
+		b.c = ' ';
+		for (size_t i = 0; i < maxMarks; i++)
+			b.marks[i] = 0;
+		b.r.bg = pen.bg;
+		return b;
+	}
+
+	void Screen::damageCells(size_t r, size_t left, size_t right)
+	{
+		Rect &d = damage[r];
+		if (d.empty())
+		{
+			d.left = left;
+			d.right = right;
+		}
+		else
+		{
+			d.left = min(d.left, left);
+			d.right = max(d.right, right);
+		}
+	}
+
+	void Screen::damageRows(size_t top, size_t bottom)
+	{
+		for (size_t r = top; r < bottom; r++)
+			damageCells(r, 0, cols);
+	}
+
+	void Screen::fill(size_t r, size_t left, size_t right)
+	{
+		if (left >= right)
+			return ;
+
+		// a wide character cut by either end is erased whole
+		Cell *line = &grid[r*cols];
+		if (line[left].c == wideTail && left > 0)
+			left--;
+		if (right < cols && line[right].c == wideTail)
+			right++;
+
+		std::fill(line+left, line+right, blank());
+		damageCells(r, left, right);
+	}
+
+	void Screen::scrollUp(size_t n, bool keep)
+	{
+		n = min(n, rows);
+		if (keep && historyCapacity > 0)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				const Cell *line = &grid[i*cols];
+				if (historySize < historyCapacity)
+				{
+					history.insert(history.end(), line, line+cols);
+					historySize++;
+				}
+				else
+				{
+					// the ring is full: overwrite the oldest line
+					std::copy(line, line+cols, history.begin()+historyStart*cols);
+					historyStart = (historyStart+1)%historyCapacity;
+				}
+			}
+		}
+
+		std::copy(grid.begin()+n*cols, grid.end(), grid.begin());
+		for (size_t r = rows-n; r < rows; r++)
+			fill(r, 0, cols);
+		damageRows(0, rows);
+	}
+
+	void Screen::scrollDown(size_t n)
+	{
+		n = min(n, rows);
+		std::copy_backward(grid.begin(), grid.end()-n*cols, grid.end());
+		for (size_t r = 0; r < n; r++)
+			fill(r, 0, cols);
+		damageRows(0, rows);
+	}
+
+	void Screen::lineFeed()
+	{
+		if (row+1 < rows)
+			row++;
+		else
+			scrollUp(1, true);
+	}
+
+	void Screen::moveTo(long r, long c)
+	{
+		row = (size_t)max(0L, min(r, (long)rows-1));
+		col = (size_t)max(0L, min(c, (long)cols-1));
+		wrapPending = false;
+	}
+
+	void Screen::clearWide(Cell *line, size_t c)
+	{
+		// the other half of a wide character which is partly overwritten is left blank
+		size_t left = (line[c].c == wideTail && c > 0) ? c-1 : c;
+		if (left+1 >= cols || line[left+1].c != wideTail)
+			return ;
+
+		for (size_t i = left; i < left+2; i++)
+		{
+			line[i].c = ' ';
+			for (size_t m = 0; m < maxMarks; m++)
+				line[i].marks[m] = 0;
+		}
+		damageCells(row, left, left+2);
+	}
+
+	void Screen::put(char32_t c, int width)
+	{
+		if (width > (int)cols)
+			return ;
+
+		// a character which doesn't fit before the edge goes to the next line
+		if (wrapPending || (col+width > cols && autowrap))
+		{
+			col = 0;
+			lineFeed();
+			wrapPending = false;
+		}
+		else if (col+width > cols)
+		{
+			col = cols-width;
+		}
+
+		Cell *line = &grid[row*cols];
+		clearWide(line, col);
+		if (width == 2)
+			clearWide(line, col+1);
+
+		for (int i = 0; i < width; i++)
+		{
+			Cell &cell = line[col+i];
+			cell.c = (i == 0) ? c : wideTail;
+			for (size_t m = 0; m < maxMarks; m++)
+				cell.marks[m] = 0;
+			cell.r = pen;
+		}
+		damageCells(row, col, col+width);
+
+		// a character in the last column leaves the cursor there until the next one wraps
+		if (col+width < cols)
+		{
+			col += width;
+		}
+		else
+		{
+			col = cols-1;
+			wrapPending = autowrap;
+		}
+	}
+
+	void Screen::attach(char32_t c)
+	{
+		// the character before the cursor, or under it when the cursor waits to wrap
+		size_t at = wrapPending ? col+1 : col;
+		if (at == 0)
+			return ;
+		at--;
+
+		Cell *line = &grid[row*cols];
+		if (line[at].c == wideTail && at > 0)
+			at--;
+		for (size_t m = 0; m < maxMarks; m++)
+		{
+			if (line[at].marks[m] == 0)
+			{
+				line[at].marks[m] = c;
+				damageCells(row, at, at+1);
+				return ;
+			}
+		}
+	}
+
+	void Screen::apply(AttributeText<Attribute> &t)
+	{
+		EscapeStream::visit(t, [this](string_view s) { write(s); }, [this](const Attribute &a) { apply(a); });
+	}
+
+	void Screen::apply(AttributeRope<Attribute> &r)
+	{
+		r.forEachLeaf([this](AttributeText<Attribute> &t)
+		{
+			apply(t);
+		});
+	}
+
+	void Screen::apply(const Attribute &a)
+	{
+		long n = repeat(a);
+
+		switch (a.getOpcode())
+		{
+		case Attribute::Control:
+		{
+			string_view e = a.getEscape();
+			char c = e.empty() ? 0 : e[0];
+			if (c == '\n')
+			{
+				lineFeed();
+				wrapPending = false;
+			}
+			else if (c == '\r')
+			{
+				moveTo(row, 0);
+			}
+			else if (c == '\t')
+			{
+				moveTo(row, (col/tabWidth+1)*tabWidth);
+			}
+			else if (c == '\b')
+			{
+				moveTo(row, (long)col-1);
+			}
+			break;
+		}
+
+		case Attribute::CursorUp:
+			moveTo((long)row-n, col);
+			break;
+
+		case Attribute::CursorDown:
+			moveTo(row+n, col);
+			break;
+
+		case Attribute::CursorForward:
+			moveTo(row, col+n);
+			break;
+
+		case Attribute::CursorBack:
+			moveTo(row, (long)col-n);
+			break;
+
+		case Attribute::CursorNextLine:
+			moveTo(row+n, 0);
+			break;
+
+		case Attribute::CursorPreviousLine:
+			moveTo((long)row-n, 0);
+			break;
+
+		case Attribute::CursorColumn:
+			moveTo(row, n-1);
+			break;
+
+		case Attribute::CursorPosition:
+			moveTo(n-1, max(a.getParam(1), 1)-1);
+			break;
+
+		case Attribute::EraseDisplay:
+			switch (a.getParam(0))
+			{
+			case 0:
+				fill(row, col, cols);
+				for (size_t r = row+1; r < rows; r++)
+					fill(r, 0, cols);
+				break;
+			case 1:
+				for (size_t r = 0; r < row; r++)
+					fill(r, 0, cols);
+				fill(row, 0, col+1);
+				break;
+			case 3:
+				history.clear();
+				historyStart = 0;
+				historySize = 0;
+				// fall through
+			case 2:
+				for (size_t r = 0; r < rows; r++)
+					fill(r, 0, cols);
+				break;
+			}
+			break;
+
+		case Attribute::EraseLine:
+			switch (a.getParam(0))
+			{
+			case 0:
+				fill(row, col, cols);
+				break;
+			case 1:
+				fill(row, 0, col+1);
+				break;
+			case 2:
+				fill(row, 0, cols);
+				break;
+			}
+			break;
+
+		case Attribute::ScrollUp:
+			scrollUp(n, false);
+			break;
+
+		case Attribute::ScrollDown:
+			scrollDown(n);
+			break;
+
+		case Attribute::Graphics:
+			pen.apply(a);
+			break;
+
+		case Attribute::SaveCursor:
+			savedRow = row;
+			savedCol = col;
+			savedPen = pen;
+			break;
+
+		case Attribute::RestoreCursor:
+			moveTo(savedRow, savedCol);
+			pen = savedPen;
+			break;
+
+		case Attribute::SetMode:
+		case Attribute::ResetMode:
+		{
+			bool on = (a.getOpcode() == Attribute::SetMode);
+			if (a.getParam(0) == 25)
+				cursorVisible = on;
+			else if (a.getParam(0) == 7)
+				autowrap = on;
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	void Screen::write(string_view s)
+	{
+		for (size_t i = 0; i < s.size(); )
+		{
+			char32_t c;
+			i += decodeUtf8(s.data()+i, s.size()-i, c);
+			int width = getCharWidth(c);
+			if (width > 0)
+				put(c, width);
+			else if (width == 0)
+				attach(c);
+		}
+	}
+
+	size_t Screen::getRows()
+	{
+		return rows;
+	}
+
+	size_t Screen::getCols()
+	{
+		return cols;
+	}
+
+	size_t Screen::getCursorRow()
+	{
+		return row;
+	}
+
+	size_t Screen::getCursorCol()
+	{
+		return col;
+	}
+
+	bool Screen::isCursorVisible()
+	{
+		return cursorVisible;
+	}
+
+	Rendition Screen::getRendition()
+	{
+		return pen;
+	}
+
+	const Screen::Cell *Screen::getRow(size_t r)
+	{
+		return &grid[r*cols];
+	}
+
+	const Screen::Cell &Screen::at(size_t r, size_t c)
+	{
+		return grid[r*cols+c];
+	}
+
+	string Screen::getRowText(size_t r)
+	{
+		const Cell *line = getRow(r);
+		size_t n = cols;
+		while (n > 0 && line[n-1].c == ' ' && line[n-1].marks[0] == 0)
+			n--;
+
+		string rtn;
+		rtn.reserve(n);
+		char buf[4];
+		for (size_t i = 0; i < n; i++)
+		{
+			if (line[i].c == wideTail)
+				continue;
+			rtn.append(buf, encodeUtf8(line[i].c, buf));
+			for (size_t m = 0; m < maxMarks && line[i].marks[m] != 0; m++)
+				rtn.append(buf, encodeUtf8(line[i].marks[m], buf));
+		}
+		return rtn;
+	}
+
+	string Screen::toStdString()
+	{
+		string rtn;
+		for (size_t r = 0; r < rows; r++)
+		{
+			if (r > 0)
+				rtn += '\n';
+			rtn += getRowText(r);
+		}
+		return rtn;
+	}
+
+	size_t Screen::getScrollbackSize()
+	{
+		return historySize;
+	}
+
+	const Screen::Cell *Screen::getScrollbackRow(size_t i)
+	{
+		return &history[((historyStart+i)%historyCapacity)*cols];
+	}
+
+	Screen::Rect Screen::getRowDamage(size_t r)
+	{
+		return damage[r];
+	}
+
+	Screen::Rect Screen::getDamage()
+	{
+		Rect rtn = {0, 0, 0, 0};
+		for (size_t r = 0; r < rows; r++)
+		{
+			const Rect &d = damage[r];
+			if (d.empty())
+				continue;
+
+			if (rtn.empty())
+			{
+				rtn = d;
+			}
+			else
+			{
+				rtn.left = min(rtn.left, d.left);
+				rtn.right = max(rtn.right, d.right);
+				rtn.bottom = d.bottom;
+			}
+		}
+		return rtn;
+	}
+
+	void Screen::clearDamage()
+	{
+		for (size_t r = 0; r < rows; r++)
+		{
+			damage[r].left = 0;
+			damage[r].right = 0;
+		}
+	}
+
+	void Screen::reset()
+	{
+		row = col = 0;
+		savedRow = savedCol = 0;
+		pen = savedPen = Rendition();
+		wrapPending = false;
+		autowrap = true;
+		cursorVisible = true;
+
+		grid.assign(rows*cols, blank());
+		history.clear();
+		historyStart = 0;
+		historySize = 0;
+
+		damage.resize(rows);
+		for (size_t r = 0; r < rows; r++)
+		{
+			Rect d = {r, 0, r+1, cols};
+			damage[r] = d;
+		}
+	}
+}
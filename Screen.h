@@ -0,0 +1,172 @@
+/* Copyright 2013 Oliver Katz
+ *
+ * This file is part of LibUNIXEscape.
+ *
+ * LibUNIXEscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LibUNIXEscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LibUNIXEscape.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file Screen.h
+ *  \brief Contains Screen class, a virtual terminal driven by the output of EscapeStream.
+ *  The screen is a grid of 8-byte cells, each holding one code point, stored row after row in one buffer, with a ring of lines
+ *  scrolled off the top behind it. Every change records which columns of which rows it touched,
+ *  so a consumer only has to redraw the damaged parts. */
+
+#ifndef __LIB_UNIX_ESCAPE_SCREEN_H
+#define __LIB_UNIX_ESCAPE_SCREEN_H
+
+#include "Rendition.h"
+
+/*! Namespace for all LibUNIXEscape classes/methods/global variables. */
+namespace unixescape
+{
+	/*! Class which applies parsed text and escapes to a grid of character cells, like a terminal.
+	 *  Cursor movement (A-H, f), erase (J, K), scroll (S, T), save/restore (s, u), graphics (m)
+	 *  and the cursor visibility and autowrap modes (?25, ?7) are applied, as are the \\n, \\r,
+	 *  \\t and \\b control characters. Other escapes and control characters are ignored.
+	 *  Lines scrolled off the top by a line feed are kept in the scrollback, up to its capacity. */
+	class Screen
+	{
+	public:
+		typedef EscapeStream::Attribute Attribute;
+
+		/*! Number of zero-width code points (combining marks, joiners) kept with a character, as
+		 *  many as xterm keeps by default. Further ones are dropped. */
+		static const size_t maxMarks = 2;
+
+		/*! Code point of the cell covered by the right half of a wide character. */
+		static const char32_t wideTail = 0;
+
+		/*! A character cell. */
+		typedef struct Cell
+		{
+			/*! The character's code point (a space for blank cells, wideTail for the right half of
+			 *  a wide character). */
+			char32_t c;
+
+			/*! The zero-width code points written after the character, followed by 0s. */
+			char32_t marks[maxMarks];
+
+			/*! The rendition the character was written with. */
+			Rendition r;
+		} Cell;
+
+		/*! A rectangle of cells, from row top and column left up to but not including row bottom
+		 *  and column right. */
+		typedef struct Rect
+		{
+			size_t top, left, bottom, right;
+
+			/*! Returns true if the rectangle contains no cells. */
+			bool empty() const { return (top >= bottom || left >= right); }
+		} Rect;
+
+	protected:
+		size_t rows, cols;
+		vector<Cell> grid;
+		vector<Cell> history;
+		size_t historyCapacity, historyStart, historySize;
+		vector<Rect> damage;
+
+		size_t row, col;
+		size_t savedRow, savedCol;
+		Rendition pen, savedPen;
+		bool wrapPending;
+		bool autowrap;
+		bool cursorVisible;
+
+		Cell blank();
+		void damageCells(size_t r, size_t left, size_t right);
+		void damageRows(size_t top, size_t bottom);
+		void fill(size_t r, size_t left, size_t right);
+		void scrollUp(size_t n, bool keep);
+		void scrollDown(size_t n);
+		void lineFeed();
+		void moveTo(long r, long c);
+		void put(char32_t c, int width);
+		void attach(char32_t c);
+		void clearWide(Cell *line, size_t c);
+
+	public:
+		/*! Constructor. Creates a blank screen of \a r rows and \a c columns which keeps up to
+		 *  \a scrollback lines scrolled off the top. */
+		Screen(size_t r = 24, size_t c = 80, size_t scrollback = 1000);
+
+		/*! Applies the text and escapes of \a t, the result of EscapeStream::flush(). */
+		void apply(AttributeText<Attribute> &t);
+
+		/*! Applies every leaf of \a r, the result of EscapeStream::flushParallel(). */
+		void apply(AttributeRope<Attribute> &r);
+
+		/*! Applies the escape \a a. */
+		void apply(const Attribute &a);
+
+		/*! Writes the plain text \a s at the cursor, each UTF-8 encoded character taking as many
+		 *  columns as on a terminal (see getCharWidth()): wide characters take a cell and the
+		 *  wideTail cell after it, and zero-width ones are added to the marks of the character
+		 *  before the cursor. Control characters are ignored, and ill-formed bytes are written as
+		 *  U+FFFD. */
+		void write(string_view s);
+
+		/*! Gets the number of rows. */
+		size_t getRows();
+
+		/*! Gets the number of columns. */
+		size_t getCols();
+
+		/*! Gets the row of the cursor. */
+		size_t getCursorRow();
+
+		/*! Gets the column of the cursor. */
+		size_t getCursorCol();
+
+		/*! Returns true unless the cursor was hidden with ESC [ ? 25 l. */
+		bool isCursorVisible();
+
+		/*! Gets the rendition used for the next characters written. */
+		Rendition getRendition();
+
+		/*! Returns the getCols() cells of row \a r. */
+		const Cell *getRow(size_t r);
+
+		/*! Gets the cell at row \a r and column \a c. */
+		const Cell &at(size_t r, size_t c);
+
+		/*! Returns the text of row \a r, without trailing blanks. */
+		string getRowText(size_t r);
+
+		/*! Returns the text of the whole screen, one line per row, without trailing blanks. */
+		string toStdString();
+
+		/*! Gets the number of lines in the scrollback. */
+		size_t getScrollbackSize();
+
+		/*! Returns the getCols() cells of line \a i of the scrollback, 0 being the oldest. */
+		const Cell *getScrollbackRow(size_t i);
+
+		/*! Returns the columns of row \a r changed since the last clearDamage(), as a one-row
+		 *  rectangle which is empty if the row is unchanged. */
+		Rect getRowDamage(size_t r);
+
+		/*! Returns the smallest rectangle containing every cell changed since the last clearDamage(). */
+		Rect getDamage();
+
+		/*! Marks every cell as unchanged. */
+		void clearDamage();
+
+		/*! Blanks the screen and the scrollback, and moves the cursor home. */
+		void reset();
+	};
+}
+
+#endif
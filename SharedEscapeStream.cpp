@@ -0,0 +1,140 @@
+#include "SharedEscapeStream.h"
+
+namespace unixescape
+{
+	SharedEscapeStream::SharedEscapeStream(size_t m) : written(0), closed(false), maxBatch(m), sleeping(false), parsed(0), finished(false)
+	{
+		// the list always holds a node which has already been taken, so it is never empty
+		Node *stub = new Node();
+		stub->next.store(NULL, memory_order_relaxed);
+		back.store(stub, memory_order_relaxed);
+		front = stub;
+
+		worker = thread(&SharedEscapeStream::run, this);
+	}
+
+	SharedEscapeStream::~SharedEscapeStream()
+	{
+		close();
+		worker.join();
+
+		while (front != NULL)
+		{
+			Node *n = front->next.load(memory_order_relaxed);
+			delete front;
+			front = n;
+		}
+	}
+
+	bool SharedEscapeStream::pop(string &s)
+	{
+		Node *next = front->next.load(memory_order_acquire);
+		if (next == NULL)
+			return false;
+
+		s = std::move(next->data);
+		delete front;
+		front = next;
+		return true;
+	}
+
+	void SharedEscapeStream::signal()
+	{
+		if (sleeping.load())
+		{
+			lock_guard<mutex> l(lock);
+			wake.notify_one();
+		}
+	}
+
+	bool SharedEscapeStream::write(string_view s)
+	{
+		return write(string(s));
+	}
+
+	bool SharedEscapeStream::write(string &&s)
+	{
+		// counted before it is queued, so that sync() cannot miss a write which returned before it
+		written.fetch_add(1);
+		if (closed.load())
+		{
+			written.fetch_sub(1);
+			signal();
+			return false;
+		}
+
+		Node *n = new Node();
+		n->next.store(NULL, memory_order_relaxed);
+		n->data = std::move(s);
+		Node *prev = back.exchange(n);
+		prev->next.store(n);
+
+		signal();
+		return true;
+	}
+
+	void SharedEscapeStream::run()
+	{
+		string chunk;
+		while (true)
+		{
+			batch.clear();
+			uint64_t n = 0;
+			while (batch.size() < maxBatch && pop(chunk))
+			{
+				batch += chunk;
+				n++;
+			}
+
+			if (n > 0)
+			{
+				AttributeText<EscapeStream::Attribute> t = parser.flush(string_view(batch));
+				lock_guard<mutex> l(lock);
+				if (!t.empty())
+					published.push_back(std::move(t));
+				parsed += n;
+				ready.notify_all();
+				continue;
+			}
+
+			unique_lock<mutex> l(lock);
+			sleeping.store(true);
+			wake.wait(l, [&]() { return (front->next.load() != NULL || (closed.load() && written.load() == parsed)); });
+			sleeping.store(false);
+
+			if (front->next.load() == NULL)
+			{
+				finished = true;
+				ready.notify_all();
+				return ;
+			}
+		}
+	}
+
+	bool SharedEscapeStream::read(AttributeText<EscapeStream::Attribute> &t, bool wait)
+	{
+		unique_lock<mutex> l(lock);
+		if (wait)
+			ready.wait(l, [&]() { return (!published.empty() || finished); });
+
+		if (published.empty())
+			return false;
+
+		t = std::move(published.front());
+		published.pop_front();
+		return true;
+	}
+
+	void SharedEscapeStream::sync()
+	{
+		uint64_t target = written.load();
+		unique_lock<mutex> l(lock);
+		ready.wait(l, [&]() { return (parsed >= target || finished); });
+	}
+
+	void SharedEscapeStream::close()
+	{
+		closed.store(true);
+		signal();
+	}
+}
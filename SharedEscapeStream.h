@@ -0,0 +1,111 @@
+/* Copyright 2013 Oliver Katz
+ *
+ * This file is part of LibUNIXEscape.
+ *
+ * LibUNIXEscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LibUNIXEscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LibUNIXEscape.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file SharedEscapeStream.h
+ *  \brief Contains SharedEscapeStream class, an EscapeStream which many threads can write to.
+ *  Writers hand their chunks to a lock-free queue, so they never wait for each other or for the
+ *  parser; one parser thread takes whatever has arrived, parses it with its own EscapeStream and
+ *  publishes the resulting AttributeText for the readers. */
+
+#ifndef __LIB_UNIX_ESCAPE_SHARED_ESCAPE_STREAM_H
+#define __LIB_UNIX_ESCAPE_SHARED_ESCAPE_STREAM_H
+
+#include "EscapeStream.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+/*! Namespace for all LibUNIXEscape classes/methods/global variables. */
+namespace unixescape
+{
+	/*! Front end of an EscapeStream for several writer threads and any number of readers.
+	 *  Each write() is parsed as one piece, in the order in which the writes were queued, and the
+	 *  writes of one thread stay in that thread's order. The parser thread parses all the chunks
+	 *  waiting when it wakes up (up to the batch size) into one AttributeText, so a reader gets
+	 *  fewer, larger texts when the writers are faster than the parser.
+	 *  \warning Writes from different threads can be queued between any two writes of one thread,
+	 *  so an escape sequence must not be split over several writes when other threads write too. */
+	class SharedEscapeStream
+	{
+	protected:
+		typedef struct Node
+		{
+			atomic<Node *> next;
+			string data;
+		} Node;
+
+		// the queue of chunks: a linked list which writers append to with one atomic exchange
+		alignas(64) atomic<Node *> back;
+		alignas(64) Node *front;
+		atomic<uint64_t> written;
+		atomic<bool> closed;
+
+		EscapeStream parser;
+		size_t maxBatch;
+		string batch;
+
+		mutex lock;
+		condition_variable wake;
+		condition_variable ready;
+		atomic<bool> sleeping;
+		deque<AttributeText<EscapeStream::Attribute> > published;
+		uint64_t parsed;
+		bool finished;
+
+		thread worker;
+
+		bool pop(string &s);
+		void signal();
+		void run();
+
+	public:
+		/*! Constructor. Starts the parser thread, which parses at most about \a maxBatch bytes
+		 *  into each AttributeText it publishes. */
+		SharedEscapeStream(size_t maxBatch = 1 << 20);
+
+		/*! Destructor. Closes the stream and waits for the parser thread. */
+		~SharedEscapeStream();
+
+		SharedEscapeStream(const SharedEscapeStream &s) = delete;
+		SharedEscapeStream &operator = (const SharedEscapeStream &s) = delete;
+
+		/*! Queues a copy of \a s for parsing. Never blocks. Returns false if the stream is closed. */
+		bool write(string_view s);
+
+		/*! Queues \a s for parsing without copying it. Returns false if the stream is closed. */
+		bool write(string &&s);
+
+		/*! Queues a copy of the null-terminated string \a s. */
+		bool write(const char *s) { return write(string_view(s)); }
+
+		/*! Moves the next parsed text into \a t and returns true. If there is none yet, waits for
+		 *  one if \a wait is true, and otherwise returns false. Once the stream is closed and
+		 *  everything written has been read, returns false. */
+		bool read(AttributeText<EscapeStream::Attribute> &t, bool wait = true);
+
+		/*! Waits until everything written before the call has been parsed and published. */
+		void sync();
+
+		/*! Stops accepting writes. What has been written is still parsed and can still be read. */
+		void close();
+	};
+}
+
+#endif
@@ -0,0 +1,77 @@
+#include "AttributeRope.h"
+#include <cstdlib>
+
+using namespace unixescape;
+
+int main()
+{
+	UE_TEST_HEADER("AttributeRope");
+	AttributeRope<int> rope;
+	AttributeText<int> text;
+
+	// a rope edited like an AttributeText holds the same characters and attributes
+	srand(1);
+	for (int i = 0; i < 2000; i++)
+	{
+		size_t pos = (text.size() == 0) ? 0 : rand()%(text.size()+1);
+		int op = rand()%4;
+
+		if (op == 0 || text.size() < 100)
+		{
+			AttributeText<int> t(1+rand()%(2*AttributeRope<int>::leafSize), 'a'+rand()%26);
+			t.push_back(0, i);
+			rope.insert(pos, t);
+			text.insert(pos, t);
+		}
+		else if (op == 1)
+		{
+			size_t len = rand()%64;
+			rope.erase(pos, len);
+			text.erase(pos, len);
+		}
+		else if (op == 2)
+		{
+			rope.push_back('z', i);
+			text.push_back('z', i);
+		}
+		else
+		{
+			AttributeText<int> t(rand()%8, 'r');
+			size_t len = rand()%8;
+			rope.replace(pos, len, t);
+			text.erase(pos, len);
+			text.insert(pos, t);
+		}
+	}
+	UE_TEST_ASSERT(text.size(), rope.size());
+	UE_TEST_ASSERT(true, (text.toDebugString() == rope.toAttributeText().toDebugString()));
+	UE_TEST_ASSERT(true, (text.toStdString() == rope.toStdString()));
+	UE_TEST_ASSERT(true, (text.substr(1000, 3000).toDebugString() == rope.substr(1000, 3000).toDebugString()));
+	UE_TEST_ASSERT(text.find("zz", 500), rope.find("zz", 500));
+	UE_TEST_ASSERT(text.find('z', 500), rope.find('z', 500));
+
+	// searches start in the leaf holding pos, and find matches that straddle leaves
+	bool same = true;
+	for (size_t pos = 0; pos <= text.size()+1; pos += 97)
+		same = same && text.find("rz", pos) == rope.find("rz", pos) && text.find('r', pos) == rope.find('r', pos)
+			&& text.find("zzz", pos) == rope.find("zzz", pos);
+	UE_TEST_ASSERT(true, same);
+	AttributeRope<int> tail;
+	for (int i = 0; i < 64; i++)
+		tail.append(AttributeText<int>(AttributeRope<int>::leafSize, 'a'));
+	tail.insert(tail.size()-1, "b");
+	size_t xy = tail.size()-AttributeRope<int>::leafSize-1;
+	tail.insert(xy, "xy");
+	UE_TEST_ASSERT(xy-1, tail.find("axy", xy-AttributeRope<int>::leafSize));
+	UE_TEST_ASSERT(xy-1, tail.find("axy", xy-1));
+	UE_TEST_ASSERT(tail.npos, tail.find("axy", xy));
+	UE_TEST_ASSERT(tail.size()-2, tail.find('b', tail.size()-3));
+	UE_TEST_ASSERT(tail.npos, tail.find('b', tail.size()-1));
+	UE_TEST_ASSERT(text.getAttributes(text.size()-1), rope.getAttributes(rope.size()-1));
+
+	string walked;
+	for (AttributeRope<int>::const_iterator i = rope.begin(); i != rope.end(); i++)
+		walked.push_back(*i);
+	UE_TEST_ASSERT(true, (text.chars() == walked));
+	UE_TEST_ASSERT(true, (rope.leafCount() > 1));
+}
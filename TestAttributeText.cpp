@@ -41,4 +41,115 @@ int main()
 	// String: 'hi'
 	// Attribute: 5
 	// String: '5'
-}
\ No newline at end of file
+
+	// attributes stay attached to their characters when the text is edited
+	int b = 7;
+	text.insert(1, AttributeText<int>(2, 'x', b));
+	UE_TEST_ASSERT("'h' 'x' (7) 'x' (7) 'i' '5' (5)", text.toDebugString());
+	text.erase(2, 2);
+	UE_TEST_ASSERT("'h' 'x' (7) '5' (5)", text.toDebugString());
+	UE_TEST_ASSERT("'x' (7) '5' (5)", text.substr(1).toDebugString());
+	UE_TEST_ASSERT(5, text.getAttributes(2));
+	UE_TEST_ASSERT(false, text.hasAttributes(0));
+	UE_TEST_ASSERT("hx5", text.toStdString());
+
+	// the plain characters are kept in a buffer of their own, so c_str() doesn't copy
+	text.push_back(0, 9);
+	text += "!";
+	const char *p = text.c_str();
+	UE_TEST_ASSERT("hx5!", p);
+	UE_TEST_ASSERT(true, (p == text.data()));
+	UE_TEST_ASSERT(4, text.view().size());
+	text[0] = 'H';
+	UE_TEST_ASSERT("Hx5!", text.c_str());
+
+	// reading through a const reference leaves the buffer, and the pointers into it, alone
+	p = text.c_str();
+	const AttributeText<int> &ctext = text;
+	string read;
+	for (size_t i = 0; i < ctext.size(); i++)
+		read += (ctext[i] == 0) ? '_' : ctext.at(i);
+	for (char c : ctext)
+		read += (c == 0) ? '_' : c;
+	read += ctext.front();
+	read += ctext.back();
+	UE_TEST_ASSERT("Hx5_!Hx5_!H!", read);
+	UE_TEST_ASSERT(true, (p == text.c_str()));
+
+	// segments() walks the same segments as splitByAttributes() without copying them
+	stringstream ss;
+	for (AttributeText<int>::SegmentView seg : text.segments())
+	{
+		if (seg.isAttribute())
+		{
+			ss << "(" << seg.getAttribute() << ")";
+		}
+		else
+		{
+			ss << "'";
+			for (size_t i = 0; i < seg.getString().size(); i++)
+				ss << makeCharPrintable(seg.getString()[i]);
+			ss << "'";
+		}
+	}
+	UE_TEST_ASSERT("'H'(7)'x'(5)'5'(9)'\\x0''!'", ss.str());
+
+	// searches run over the characters only, and a Searcher can be reused for the same needle
+	AttributeText<int> log("error: foo\nwarning: bar\nerror: baz\n");
+	Searcher error("error");
+	UE_TEST_ASSERT(0, log.find(error));
+	UE_TEST_ASSERT(24, log.find(error, 1));
+	UE_TEST_ASSERT(24, log.rfind(error));
+	UE_TEST_ASSERT(0, log.rfind("error", 23));
+	UE_TEST_ASSERT(17, log.find("g: b"));
+	UE_TEST_ASSERT(log.npos, log.find("fatal"));
+	UE_TEST_ASSERT(34, log.rfind('\n'));
+
+	// one-off backward searches agree with std::string for every start position, including
+	// needles that only match at the very start or end and needles longer than the text
+	string plain(log.chars());
+	const char *needles[] = {"error", "r", "\n", ": b", "baz\n", "e", "", "fatal", "error: foo\nwarning: bar\nerror: baz\n!"};
+	bool same = true;
+	for (const char *n : needles)
+		for (size_t pos = 0; pos <= plain.size()+1; pos++)
+			same = same && log.rfind(n, pos) == plain.rfind(n, pos)
+				&& log.rfind(AttributeText<int>(n), pos) == plain.rfind(n, pos);
+	UE_TEST_ASSERT(true, same);
+	UE_TEST_ASSERT(24, log.rfind("error", log.npos-1));
+
+	// moving takes over the buffers, and appending a temporary to an empty text doesn't copy it
+	AttributeText<int> moved(std::move(log));
+	UE_TEST_ASSERT(true, log.empty());
+	UE_TEST_ASSERT(0, moved.find(error));
+	AttributeText<int> built;
+	AttributeText<int> part("a long enough string to live on the heap, ab");
+	part.push_back('c', 3);
+	const char *buffer = part.data();
+	built += std::move(part);
+	UE_TEST_ASSERT(true, (built.data() == buffer));
+	UE_TEST_ASSERT(true, part.empty());
+	part = "de";
+	part.push_back('f', 4);
+	built.append(std::move(part));
+	UE_TEST_ASSERT(3, built.getAttributes(44));
+	UE_TEST_ASSERT(4, built.getAttributes(47));
+	UE_TEST_ASSERT(2, built.attributeCount());
+	UE_TEST_ASSERT("heap, abcdef", built.view().substr(36));
+	built = AttributeText<int>("xyz");
+	UE_TEST_ASSERT(false, built.hasAttributes(2));
+	UE_TEST_ASSERT("xyz", built.toStdString());
+
+	// UTF-8 text is read by code point or by grapheme cluster, across attributes
+	AttributeText<int> u("e\xcc\x81 \xf0\x9f\x87\xab\xf0\x9f\x87\xb7\xf0\x9f\x87\xa9\xf0\x9f\x87\xaa"
+		"\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x92\xbb\r\na");
+	u.push_back(0, 7);
+	u.append("\xcc\x81\xff");
+	string points;
+	for (const CodePoint &c : u.codePoints())
+		points += to_string((unsigned long)c.value)+"@"+to_string(c.pos)+" ";
+	UE_TEST_ASSERT("101@0 769@1 32@3 127467@4 127479@8 127465@12 127466@16 128105@20 8205@24 128187@27 13@31 10@32 97@33 769@35 65533@37 ", points);
+	string clusters;
+	for (const Grapheme &g : u.graphemes())
+		clusters += to_string(g.pos)+"+"+to_string(g.size)+" ";
+	UE_TEST_ASSERT("0+3 3+1 4+8 12+8 20+11 31+2 33+4 37+1 ", clusters);
+}
@@ -0,0 +1,104 @@
+#include "EscapeStream.h"
+#include <thread>
+
+using namespace unixescape;
+
+int main()
+{
+	UE_TEST_HEADER("Counters");
+	EscapeStream es;
+
+	// nothing is counted until counting is enabled
+	Counters::reset();
+	es.flush("a\033[1mb");
+	UE_TEST_ASSERT(0, Counters::snapshot().get(Counters::BytesParsed));
+	UE_TEST_ASSERT(false, Counters::isEnabled());
+
+	// the parser counts bytes, escapes by opcode and the sequences and characters it drops
+	Counters::enable();
+	string input = "a\033[1mb\033[31mc\n\033[1;\x01\033[2Jd\xc3(e\033[?25l";
+	es.flush(input);
+	Counters::Snapshot s = Counters::snapshot();
+	UE_TEST_ASSERT(input.size(), s.get(Counters::BytesParsed));
+	UE_TEST_ASSERT(1, s.get(Counters::Flushes));
+	UE_TEST_ASSERT(5, s.get(Counters::Escapes));
+	UE_TEST_ASSERT(2, s.getEscapes(EscapeStream::Attribute::Graphics));
+	UE_TEST_ASSERT(1, s.getEscapes(EscapeStream::Attribute::Control));
+	UE_TEST_ASSERT(1, s.getEscapes(EscapeStream::Attribute::EraseDisplay));
+	UE_TEST_ASSERT(1, s.getEscapes(EscapeStream::Attribute::ResetMode));
+	UE_TEST_ASSERT(1, s.get(Counters::SequencesAbandoned));
+	UE_TEST_ASSERT(1, s.get(Counters::InvalidUtf8));
+	UE_TEST_ASSERT(true, (s.getLatencyPercentile(0.5) > 0));
+	UE_TEST_ASSERT(0, s.toString().find("bytes_parsed " + to_string(input.size()) + "\n"));
+	UE_TEST_ASSERT(true, (s.toString().find("escapes_graphics 2\n") != string::npos));
+
+	// a parallel flush counts each byte once, even when a chunk has to be parsed again
+	string text;
+	for (int i = 0; i < 200; i++)
+		text += "line \033[3" + to_string(i%8) + "m" + to_string(i) + "\033[i@a long ident body@\r\n";
+	Counters::reset();
+	es.flush(text);
+	Counters::Snapshot serial = Counters::snapshot();
+	Counters::reset();
+	es.flushParallel(text, WorkPool::shared(), 7);
+	Counters::Snapshot parallel = Counters::snapshot();
+	UE_TEST_ASSERT(serial.get(Counters::BytesParsed), parallel.get(Counters::BytesParsed));
+	UE_TEST_ASSERT(serial.get(Counters::Escapes), parallel.get(Counters::Escapes));
+	UE_TEST_ASSERT(serial.getEscapes(EscapeStream::Attribute::Ident), parallel.getEscapes(EscapeStream::Attribute::Ident));
+
+	// so are the sequences and characters cut off by an escape, wherever the chunks end
+	string broken;
+	for (int i = 0; i < 100; i++)
+		broken += "ab\033[1;3\033[3" + to_string(i%8) + "mc\xe2\x86\033[m\033[1;2;3;4?5m\033[1;?\033[K\033[i@id@d\xc3(";
+	bool same = true;
+	for (size_t chunk : {3, 7, 16, 61})
+	{
+		EscapeStream a, b;
+		Counters::reset();
+		a.flush(broken);
+		serial = Counters::snapshot();
+		Counters::reset();
+		b.flushParallel(broken, WorkPool::shared(), chunk);
+		parallel = Counters::snapshot();
+		for (Counters::Counter c : {Counters::BytesParsed, Counters::Escapes, Counters::SequencesAbandoned, Counters::InvalidUtf8})
+			same = same && (serial.get(c) == parallel.get(c));
+		for (unsigned op = 0; op < Counters::maxOpcodes; op++)
+			same = same && (serial.getEscapes(op) == parallel.getEscapes(op));
+	}
+	UE_TEST_ASSERT(true, same);
+	UE_TEST_ASSERT(300, serial.get(Counters::SequencesAbandoned));
+	UE_TEST_ASSERT(200, serial.get(Counters::InvalidUtf8));
+
+	// flushes longer than the histogram covers are not reported under its last bound
+	Counters::reset();
+	Counters::addFlushLatency(1000);
+	Counters::addFlushLatency((uint64_t)1 << 50);
+	s = Counters::snapshot();
+	UE_TEST_ASSERT(1024, s.getLatencyPercentile(0.5));
+	UE_TEST_ASSERT(UINT64_MAX, s.getLatencyPercentile(1));
+	UE_TEST_ASSERT(true, (s.toString().find("flush_latency_le_inf 1\n") != string::npos));
+	UE_TEST_ASSERT(string::npos, s.toString().find("flush_latency_le_549755813888"));
+
+	// the character buffers of AttributeText count their growth
+	Counters::reset();
+	AttributeText<int> t;
+	for (int i = 0; i < 1000; i++)
+		t.append("abcd", 4);
+	s = Counters::snapshot();
+	UE_TEST_ASSERT(true, (s.get(Counters::TextReallocations) > 0 && s.get(Counters::TextReallocations) < 20));
+	UE_TEST_ASSERT(true, (s.get(Counters::TextBytesCopied) > 4000));
+
+	// the counts of threads are kept after they exit
+	Counters::reset();
+	thread worker([]()
+	{
+		EscapeStream e;
+		e.flush("\033[1mworker");
+	});
+	worker.join();
+	UE_TEST_ASSERT(1, Counters::snapshot().get(Counters::Escapes));
+
+	Counters::enable(false);
+	es.flush("\033[1m");
+	UE_TEST_ASSERT(1, Counters::snapshot().get(Counters::Escapes));
+}
@@ -0,0 +1,292 @@
+#include "EscapeStream.h"
+#include "EscapeEncoder.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace unixescape;
+
+string describe(AttributeText<EscapeStream::Attribute> t)
+{
+	stringstream ss;
+	vector<AttributeText<EscapeStream::Attribute>::Segment> tmp = t.splitByAttributes();
+	for (size_t i = 0; i < tmp.size(); i++)
+	{
+		if (tmp[i].isAttribute())
+		{
+			ss << "[";
+			string_view e = tmp[i].getAttribute().getEscape();
+			for (size_t j = 0; j < e.size(); j++)
+				ss << makeCharPrintable(e[j]);
+			ss << "]";
+		}
+		else if (tmp[i].getString() != string(1, '\0'))
+		{
+			ss << tmp[i].getString();
+		}
+	}
+	return ss.str();
+}
+
+int main()
+{
+	UE_TEST_HEADER("EscapeStream");
+	EscapeStream es;
+
+	// whole sequences in one flush
+	es.stream() << "a\033[1mb\033[31mc\033[12;34Hd\033[?25le\033[i@name@f\033[Kg\n";
+	UE_TEST_ASSERT("a[\\x1b[1m]b[\\x1b[31m]c[\\x1b[12;34H]d[\\x1b[?25l]e[\\x1b[i@name@]f[\\x1b[K]g[\\xa]", describe(es.flush()));
+	UE_TEST_ASSERT(false, es.pending());
+
+	// attributes carry the kind of escape and its arguments, and equal escapes share their text
+	es.stream() << "\033[12;34H\033[12;34H";
+	AttributeText<EscapeStream::Attribute> pos = es.flush();
+	UE_TEST_ASSERT(EscapeStream::Attribute::CursorPosition, pos.getAttributes(0).getOpcode());
+	UE_TEST_ASSERT(2, pos.getAttributes(0).getParamCount());
+	UE_TEST_ASSERT(34, pos.getAttributes(0).getParam(1));
+	UE_TEST_ASSERT(true, (pos.getAttributes(0) == pos.getAttributes(1)));
+	UE_TEST_ASSERT(true, (pos.getAttributes(0).getEscape().data() == pos.getAttributes(1).getEscape().data()));
+
+	// sequences split across flushes are carried over
+	es.stream() << "x\033";
+	UE_TEST_ASSERT("x", describe(es.flush()));
+	UE_TEST_ASSERT(true, es.pending());
+	es.stream() << "[3";
+	UE_TEST_ASSERT("", describe(es.flush()));
+	es.stream() << "1;4";
+	UE_TEST_ASSERT("", describe(es.flush()));
+	es.stream() << "2my\033[i@ab";
+	UE_TEST_ASSERT("[\\x1b[31;42m]y", describe(es.flush()));
+	es.stream() << "c@z";
+	UE_TEST_ASSERT("[\\x1b[i@abc@]z", describe(es.flush()));
+	UE_TEST_ASSERT(false, es.pending());
+
+	// byte-at-a-time feeding gives the same result as one flush
+	string input = "a\033[1mb\033[31mc\033[12;34Hd\033[?25le\033[i@name@f\033[Kg\n";
+	string chunked;
+	for (size_t i = 0; i < input.size(); i++)
+	{
+		es.stream() << input[i];
+		chunked += describe(es.flush());
+	}
+	es.stream() << input;
+	UE_TEST_ASSERT(describe(es.flush()), chunked);
+
+	// long printable runs are copied in bulk, up to the next escape or control byte
+	for (size_t n = 0; n < 80; n += 7)
+	{
+		string run(n, 'r');
+		es.stream() << run << "\033[1m" << run << "\t" << run;
+		UE_TEST_ASSERT(run+"[\\x1b[1m]"+run+"[\\x9]"+run, describe(es.flush()));
+	}
+
+	// malformed sequences are dropped along with the offending byte, and an escape restarts the parser
+	es.stream() << "a\033[1;\x01\033[2Jc\033[i@";
+	UE_TEST_ASSERT("a[\\x1b[2J]c", describe(es.flush()));
+	es.reset();
+	es.stream() << "d@";
+	UE_TEST_ASSERT("d@", describe(es.flush()));
+
+	// control sequences may have any number of arguments, a private marker and intermediate bytes
+	es.stream() << "\033[38;2;255;128;0m\033[1;4;31m\033[H\033[5 q\033[>1c";
+	AttributeText<EscapeStream::Attribute> csi = es.flush();
+	UE_TEST_ASSERT("[\\x1b[38;2;255;128;0m][\\x1b[1;4;31m][\\x1b[H][\\x1b[5 q][\\x1b[>1c]", describe(csi));
+	UE_TEST_ASSERT(5, csi.getAttributes(0).getParamCount());
+	UE_TEST_ASSERT(128, csi.getAttributes(0).getParam(3));
+	UE_TEST_ASSERT(0, csi.getAttributes(0).getParam(4));
+	UE_TEST_ASSERT(0, csi.getAttributes(0).getParam(5));
+	UE_TEST_ASSERT(EscapeStream::Attribute::Graphics, csi.getAttributes(1).getOpcode());
+	UE_TEST_ASSERT(31, csi.getAttributes(1).getParam(2));
+	UE_TEST_ASSERT(EscapeStream::Attribute::CursorPosition, csi.getAttributes(2).getOpcode());
+	UE_TEST_ASSERT(0, csi.getAttributes(2).getParamCount());
+	UE_TEST_ASSERT(EscapeStream::Attribute::Other, csi.getAttributes(3).getOpcode());
+	UE_TEST_ASSERT(" ", csi.getAttributes(3).getIntermediates());
+	UE_TEST_ASSERT(EscapeStream::Attribute::Other, csi.getAttributes(4).getOpcode());
+	UE_TEST_ASSERT("", csi.getAttributes(4).getIntermediates());
+
+	// oversized sequences are skipped up to their final byte, without keeping their arguments
+	string many = "\033[";
+	for (size_t i = 0; i <= EscapeStream::maxParams; i++)
+		many += "1;";
+	es.stream() << "a" << many << "mb\033[" << string(EscapeStream::maxSequence, '0') << "1mc\033[1 2md";
+	UE_TEST_ASSERT("abcd", describe(es.flush()));
+	UE_TEST_ASSERT(false, es.pending());
+
+	// a flush can allocate its result from an arena; copies of it go back to the default heap
+	char buffer[4096];
+	pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+	es.stream() << "a\033[1mb";
+	AttributeText<EscapeStream::Attribute> arenaText = es.flush(&arena);
+	UE_TEST_ASSERT(true, (arenaText.getResource() == &arena));
+	UE_TEST_ASSERT("a[\\x1b[1m]b", describe(arenaText));
+	UE_TEST_ASSERT(true, (AttributeText<EscapeStream::Attribute>(arenaText).getResource() == pmr::get_default_resource()));
+
+	// the parallel parse gives the same result as the serial one wherever the chunks are cut
+	WorkPool pool(4);
+	string mixed;
+	for (int i = 0; i < 20; i++)
+		mixed += "line \033[1;3" + to_string(i%8) + "mred\033[0m\tdone\033[i@a long ident body " + to_string(i) + "@\r\n";
+	mixed += "\033[12;3";
+	EscapeStream serial;
+	serial.stream() << mixed;
+	string expected = describe(serial.flush());
+	for (size_t chunk = 1; chunk < 64; chunk += 5)
+	{
+		es.reset();
+		es.stream() << mixed;
+		UE_TEST_ASSERT(expected, describe(es.flushParallel(pool, chunk).toAttributeText()));
+		UE_TEST_ASSERT(true, es.pending());
+	}
+	es.stream() << "4H";
+	UE_TEST_ASSERT("[\\x1b[12;34H]", describe(es.flushParallel(pool, 1).toAttributeText()));
+
+	// data can be parsed straight from memory, a mapped file or a file descriptor
+	serial.reset();
+	UE_TEST_ASSERT(expected, describe(serial.flush(mixed)));
+	serial.reset();
+	string path = "/tmp/TestEscapeStream." + to_string(getpid());
+	ofstream(path) << mixed;
+	{
+		MappedFile file(path.c_str());
+		UE_TEST_ASSERT(true, file.isOpen());
+		UE_TEST_ASSERT(expected, describe(serial.flush(file.view())));
+		serial.reset();
+		UE_TEST_ASSERT(expected, describe(serial.flushParallel(file.view(), pool, 16).toAttributeText()));
+		serial.reset();
+	}
+	int fd = open(path.c_str(), O_RDONLY);
+	UE_TEST_ASSERT(expected, describe(serial.read(fd)));
+	close(fd);
+	unlink(path.c_str());
+	UE_TEST_ASSERT(true, serial.pending());
+	serial.stream() << "4H";
+	UE_TEST_ASSERT("[\\x1b[12;34H]", describe(serial.flush()));
+
+	// encoding a flush gives back the bytes that were flushed
+	string whole = mixed.substr(0, mixed.rfind('\033'));
+	AttributeText<EscapeStream::Attribute> parsed = serial.flush(whole);
+	string encoded = "prefix";
+	UE_TEST_ASSERT(whole.size(), EscapeEncoder::encode(parsed, encoded));
+	UE_TEST_ASSERT("prefix"+whole, encoded);
+	es.reset();
+	AttributeRope<EscapeStream::Attribute> rope = es.flushParallel(whole, pool, 16);
+	encoded.clear();
+	EscapeEncoder::encode(rope, encoded);
+	UE_TEST_ASSERT(whole, encoded);
+
+	int fds[2];
+	UE_TEST_ASSERT(0, pipe(fds));
+	EscapeEncoder encoder;
+	UE_TEST_ASSERT(true, encoder.write(fds[1], parsed));
+	UE_TEST_ASSERT(true, encoder.write(fds[1], rope));
+	close(fds[1]);
+	string piped;
+	char chunk[256];
+	for (ssize_t n; (n = ::read(fds[0], chunk, sizeof(chunk))) > 0; )
+		piped.append(chunk, n);
+	close(fds[0]);
+	UE_TEST_ASSERT(whole+whole, piped);
+
+	// UTF-8 characters are plain text, and ill-formed bytes are dropped like other non-printable bytes
+	EscapeStream u;
+	string utf8 = "caf\xc3\xa9 \xe2\x86\x92 \xf0\x9f\x98\x80 \xce\xb1\xce\xb2\xce\xb3 \xe4\xb8\xad\xe6\x96\x87 ";
+	UE_TEST_ASSERT(utf8+utf8+"[\\x1b[1m]"+utf8, describe(u.flush(utf8+utf8+"\033[1m"+utf8)));
+	string broken = "a\xc3(b\xed\xa0\x80" "c\xc0\xaf" "d\xf4\x90\x80\x80" "e\x80" "f\xe2\x86";
+	UE_TEST_ASSERT("a(bcdefa(bcdefa(bcdef[\\x1b[m]", describe(u.flush(broken+broken+broken+"\033[m")));
+
+	// a character cut off by the end of a flush is completed by the next one
+	string bytes;
+	for (size_t i = 0; i < utf8.size(); i++)
+		bytes += u.flush(string_view(utf8.data()+i, 1)).toStdString();
+	UE_TEST_ASSERT(utf8, bytes);
+	u.stream() << "\xf0\x9f";
+	UE_TEST_ASSERT("", describe(u.flush()));
+	UE_TEST_ASSERT(true, u.pending());
+	u.stream() << "\x98\x80!";
+	UE_TEST_ASSERT("\xf0\x9f\x98\x80!", describe(u.flush()));
+	UE_TEST_ASSERT("", describe(u.flush("\xe2\x86")));
+	UE_TEST_ASSERT("x[\\x1b[1m]", describe(u.flush("x\033[1m")));
+
+	// chunks of a parallel flush don't cut characters
+	string text;
+	for (int i = 0; i < 50; i++)
+		text += utf8+(i%7 == 0 ? "\033[3"+to_string(i%8)+"m" : "");
+	UE_TEST_ASSERT(describe(u.flush(text)), describe(u.flushParallel(text, pool, 16).toAttributeText()));
+
+	// stripping keeps the text and control characters of a flush, and maps them back to the input
+	EscapeStream st;
+	string in = "ab\033[1;31mcd\033[i@x@e\n\x01" "f\033[?25l\xc3\xa9";
+	string stripped;
+	EscapeStream::OffsetMap map;
+	UE_TEST_ASSERT(9, st.strip(in, stripped, &map));
+	UE_TEST_ASSERT("abcde\nf\xc3\xa9", stripped);
+	UE_TEST_ASSERT(5, map.runs.size());
+	size_t offsets[] = {0, 1, 9, 10, 17, 18, 20, 27, 28};
+	bool mapped = true;
+	for (size_t i = 0; i < stripped.size(); i++)
+		mapped = mapped && (map.getInputOffset(i) == offsets[i]);
+	UE_TEST_ASSERT(true, mapped);
+
+	// a stripped stream carries sequences over like flush(), and matches its text
+	st.stream() << "x\033[3";
+	UE_TEST_ASSERT("x", st.strip());
+	st.stream() << "2my\xf0\x9f";
+	UE_TEST_ASSERT("y", st.strip());
+	UE_TEST_ASSERT("\xf0\x9f\x98\x80z", st.strip("\x98\x80z\033[m"));
+	string flushed = u.flush(text).toStdString();
+	flushed.erase(remove(flushed.begin(), flushed.end(), 0), flushed.end());
+	UE_TEST_ASSERT(flushed, st.strip(text));
+
+	// a visitor gets the events of the parse, with their positions, and only defines the callbacks it needs
+	struct Recorder : EscapeStream::Visitor
+	{
+		string events;
+
+		void onText(string_view s, size_t pos) { events += to_string(pos) + "'" + string(s) + "' "; }
+		void onControl(char c, size_t pos) { events += to_string(pos) + "^" + to_string((int)c) + " "; }
+		void onCsi(EscapeStream::Attribute::Opcode op, string_view seq, const int *params, size_t count, size_t pos)
+		{
+			events += to_string(pos) + "op" + to_string(op) + "(";
+			for (size_t i = 0; i < count; i++)
+				events += to_string(params[i]) + (i+1 < count ? "," : "");
+			events += ") ";
+		}
+	} rec;
+	EscapeStream vs;
+	vs.parse("ab\033[1;31mc\a\033[5;", rec);
+	vs.parse("9Hd", rec);
+	UE_TEST_ASSERT("0'ab' 2op13(1,31) 9'c' 10^7 0op8(5,9) 2'd' ", rec.events);
+
+	struct Bells : EscapeStream::Visitor
+	{
+		int n = 0;
+		void onControl(char c, size_t pos) { n += (c == '\a'); }
+	} bells;
+	vs.parse("\a\033[1m\a x \a", bells);
+	UE_TEST_ASSERT(3, bells.n);
+	UE_TEST_ASSERT(false, vs.pending());
+
+	// once the table of escapes is full, new escapes keep their text and arguments in spill slots
+	for (int i = 0; i < 1100; i++)
+		EscapeStream::Attribute(EscapeStream::Attribute::Other, to_string(i)+string(64 << 10, 'x'));
+	string novel = "a\033[38;2;10;20;30mb\033[4:3mc\033[12;34H";
+	EscapeStream full;
+	AttributeText<EscapeStream::Attribute> spilled = full.flush(novel);
+	EscapeStream::Attribute rgb = spilled.getAttributes(1);
+	UE_TEST_ASSERT(true, EscapeStream::Attribute::isSpilled(rgb.id));
+	UE_TEST_ASSERT("\033[38;2;10;20;30m", rgb.getEscape());
+	UE_TEST_ASSERT(5, rgb.getParamCount());
+	UE_TEST_ASSERT(30, rgb.getParam(4));
+	UE_TEST_ASSERT(true, spilled.getAttributes(3).isSubParam(1));
+	string roundTrip;
+	EscapeEncoder::encode(spilled, roundTrip);
+	UE_TEST_ASSERT(novel, roundTrip);
+
+	// copies share a slot, which outlives the text it came from, and equal escapes compare equal
+	spilled = AttributeText<EscapeStream::Attribute>();
+	UE_TEST_ASSERT("\033[38;2;10;20;30m", rgb.getEscape());
+	UE_TEST_ASSERT(true, (full.flush("\033[38;2;10;20;30m").getAttributes(0) == rgb));
+	UE_TEST_ASSERT(false, (EscapeStream::Attribute(EscapeStream::Attribute::Other, "\033[38;2;10;20;31m") == rgb));
+	uint32_t slot = rgb.id;
+	rgb = EscapeStream::Attribute();
+	UE_TEST_ASSERT("", EscapeStream::Attribute::lookup(slot));
+}
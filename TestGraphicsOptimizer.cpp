@@ -0,0 +1,108 @@
+#include "GraphicsOptimizer.h"
+#include "EscapeEncoder.h"
+#include "Screen.h"
+
+using namespace unixescape;
+
+string optimize(GraphicsOptimizer &o, string s)
+{
+	EscapeStream es;
+	AttributeText<EscapeStream::Attribute> t = es.flush(s);
+	AttributeText<EscapeStream::Attribute> opt = o.optimize(t);
+	o.finish(opt);
+	string rtn;
+	EscapeEncoder::encode(opt, rtn);
+	return rtn;
+}
+
+int main()
+{
+	UE_TEST_HEADER("GraphicsOptimizer");
+	GraphicsOptimizer o;
+
+	// runs of escapes collapse into the one change the next character sees
+	UE_TEST_ASSERT("a\033[1mb\033[mc", optimize(o, "a\033[0m\033[0m\033[1m\033[0m\033[1mb\033[0m\033[0mc"));
+	UE_TEST_ASSERT(7, o.getStats().escapesIn);
+	UE_TEST_ASSERT(2, o.getStats().escapesOut);
+	UE_TEST_ASSERT(28-7, o.getStats().getBytesSaved());
+
+	// escapes which change nothing are dropped, and the state carries over from one call to the next
+	o.resetStats();
+	UE_TEST_ASSERT("\033[31mred", optimize(o, "\033[31mred"));
+	UE_TEST_ASSERT(" more", optimize(o, "\033[31m more"));
+	UE_TEST_ASSERT(" end\033[m", optimize(o, "\033[31m end\033[0m"));
+	UE_TEST_ASSERT(19-8, o.getStats().getBytesSaved());
+
+	// parameters Rendition doesn't keep, like the underline color, are copied unchanged up to the next reset
+	o.reset();
+	UE_TEST_ASSERT("\033[58;5;208mx\033[1m\033[39my\033[0mz\033[4mw", optimize(o, "\033[58;5;208mx\033[1m\033[39my\033[0mz\033[1m\033[0m\033[4mw"));
+
+	// 256-color and RGB colors are optimized like the others
+	o.reset();
+	UE_TEST_ASSERT("\033[38;5;208mx\033[0;1my\033[48;2;1;2;3mz", optimize(o, "\033[38;5;208mx\033[1m\033[39my\033[48;2;1;2;3m\033[48;2;1;2;3mz"));
+
+	// the shortest transition is chosen: turning one flag off, or resetting
+	Rendition from, to;
+	from.applyParam(1);
+	from.applyParam(2);
+	from.applyParam(31);
+	to = from;
+	to.applyParam(22);
+	to.applyParam(2);
+	int params[GraphicsOptimizer::maxParams];
+	UE_TEST_ASSERT(2, GraphicsOptimizer::transition(from, to, params));
+	UE_TEST_ASSERT(22, params[0]);
+	UE_TEST_ASSERT(2, params[1]);
+	to = Rendition();
+	to.applyParam(4);
+	UE_TEST_ASSERT(2, GraphicsOptimizer::transition(from, to, params));
+	UE_TEST_ASSERT(0, params[0]);
+	UE_TEST_ASSERT(4, params[1]);
+	UE_TEST_ASSERT(0, GraphicsOptimizer::transition(to, to, params));
+
+	// the optimized stream draws the same screen as the original
+	string colored;
+	for (int i = 0; i < 40; i++)
+		colored += "\033[0m\033[1m\033[3" + to_string(i%8) + "mline " + to_string(i) + "\033[0m\033[0m\r\n\033[4m\033[24m";
+	o.reset();
+	string optimized = optimize(o, colored);
+	UE_TEST_ASSERT(true, (optimized.size() < colored.size()/2));
+	Screen a(10, 20), b(10, 20);
+	EscapeStream es;
+	AttributeText<EscapeStream::Attribute> ta = es.flush(colored), tb = es.flush(optimized);
+	a.apply(ta);
+	b.apply(tb);
+	bool same = true;
+	for (size_t r = 0; r < 10; r++)
+		for (size_t c = 0; c < 20; c++)
+			same = same && (a.at(r, c).c == b.at(r, c).c && a.at(r, c).r == b.at(r, c).r);
+	UE_TEST_ASSERT(true, same);
+
+	// sub-parameters after ':' belong to the parameter before them, not to the list
+	AttributeText<EscapeStream::Attribute> curly = es.flush("\033[4:3m"), rgb = es.flush("\033[38:2::10:20:31;1m");
+	UE_TEST_ASSERT(true, curly.getAttributes(0).isSubParam(1));
+	UE_TEST_ASSERT(false, rgb.getAttributes(0).isSubParam(0));
+	UE_TEST_ASSERT(true, (rgb.getAttributes(0).isSubParam(1) && rgb.getAttributes(0).isSubParam(5)));
+	UE_TEST_ASSERT(false, rgb.getAttributes(0).isSubParam(6));
+
+	// in a long escape too, the sub-parameters are found wherever they are
+	string wide = "\033[1";
+	for (int i = 1; i < 120; i++)
+		wide += (i == 63 || i == 64 || i == 100) ? ":3" : ";1";
+	EscapeStream::Attribute many = es.flush(wide+"m").getAttributes(0);
+	UE_TEST_ASSERT(120, many.getParamCount());
+	UE_TEST_ASSERT(true, (many.isSubParam(63) && many.isSubParam(64) && many.isSubParam(100)));
+	UE_TEST_ASSERT(false, (many.isSubParam(62) || many.isSubParam(65) || many.isSubParam(99) || many.isSubParam(119)));
+	Rendition rc, rr;
+	UE_TEST_ASSERT(false, rc.apply(curly.getAttributes(0)));
+	UE_TEST_ASSERT((int)Rendition::Underline, (int)rc.flags);
+	UE_TEST_ASSERT(true, rr.apply(rgb.getAttributes(0)));
+	UE_TEST_ASSERT((int)Rendition::Bold, (int)rr.flags);
+	UE_TEST_ASSERT(Rendition::rgbColor(10, 20, 31), rr.fg);
+
+	// so the optimizer keeps the styles it can't represent as written, and rewrites the plain ones
+	o.reset();
+	UE_TEST_ASSERT("\033[4:3mx\033[0my", optimize(o, "\033[4:3mx\033[0my"));
+	UE_TEST_ASSERT("\033[1;38;2;10;20;31mx\033[my", optimize(o, "\033[38:2::10:20:31;1mx\033[0my"));
+	UE_TEST_ASSERT("\033[4mx\033[my", optimize(o, "\033[4:1mx\033[4:0my"));
+}
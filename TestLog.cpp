@@ -0,0 +1,110 @@
+#include "Log.h"
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+
+using namespace unixescape;
+
+string readAll(int fd)
+{
+	string rtn;
+	char buf[4096];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		rtn.append(buf, n);
+	return rtn;
+}
+
+int main()
+{
+	UE_TEST_HEADER("Log");
+
+	// messages from several threads all arrive, whole and each in its thread's order
+	int p[2];
+	UE_TEST_ASSERT(0, pipe(p));
+	fcntl(p[0], F_SETFL, O_NONBLOCK);
+	{
+		AsyncLog l(p[1], 1024);
+		vector<thread> threads;
+		for (int t = 0; t < 4; t++)
+		{
+			threads.push_back(thread([&l, t]() {
+				for (int i = 0; i < 100; i++)
+					l.push(to_string(t) + ":" + to_string(i) + "\n");
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+		l.flush();
+		UE_TEST_ASSERT(0, l.getDropped());
+
+		string out = readAll(p[0]);
+		UE_TEST_ASSERT(400, count(out.begin(), out.end(), '\n'));
+		for (int t = 0; t < 4; t++)
+		{
+			size_t a = out.find("\n" + to_string(t) + ":10\n");
+			size_t b = out.find("\n" + to_string(t) + ":90\n");
+			UE_TEST_ASSERT(true, (a != string::npos && b != string::npos && a < b));
+		}
+
+		// long messages are truncated to one slot
+		l.push(string(AsyncLog::slotSize*2, 'x'));
+		l.flush();
+		UE_TEST_ASSERT(AsyncLog::slotSize, readAll(p[0]).size());
+	}
+
+	// a full ring drops messages instead of blocking, and counts them
+	{
+		AsyncLog l(p[1], 4);
+		size_t accepted = 0;
+		for (int i = 0; i < 10000; i++)
+			accepted += l.push("m\n");
+		l.flush();
+		UE_TEST_ASSERT(10000, accepted+l.getDropped());
+		UE_TEST_ASSERT(accepted, readAll(p[0]).size()/2);
+	}
+
+	// the macros go to the installed log, and back to the console once it is destroyed
+	{
+		AsyncLog l(p[1]);
+		AsyncLog::install(&l);
+		UE_TEST_ASSERT(true, (AsyncLog::installed() == &l));
+		UE_WARNING("queued " << 42);
+		UE_TRACE("compiled out");
+		flushLog();
+		string out = readAll(p[0]);
+		UE_TEST_ASSERT(true, (out.find("warning: queued 42\n") != string::npos));
+		UE_TEST_ASSERT(string::npos, out.find("compiled out"));
+	}
+	UE_TEST_ASSERT(true, (AsyncLog::installed() == NULL));
+
+	// destroying the installed log waits for the threads still logging through it
+	{
+		atomic<bool> started(false);
+		vector<thread> threads;
+		{
+			AsyncLog l(p[1], 64);
+			AsyncLog::install(&l);
+			for (int t = 0; t < 4; t++)
+			{
+				threads.push_back(thread([&started]() {
+					started.store(true);
+					while (AsyncLog::installed() != NULL)
+						UE_WARNING("racing");
+				}));
+			}
+			while (!started.load())
+				this_thread::yield();
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+		readAll(p[0]);
+		UE_TEST_ASSERT(true, (AsyncLog::installed() == NULL));
+	}
+
+	close(p[0]);
+	close(p[1]);
+	return 0;
+}
@@ -0,0 +1,138 @@
+#include "Screen.h"
+
+using namespace unixescape;
+
+int main()
+{
+	UE_TEST_HEADER("Screen");
+	EscapeStream es;
+	Screen screen(4, 10, 2);
+	AttributeText<EscapeStream::Attribute> t;
+
+	// text is written at the cursor, and control characters and escapes move it
+	es.stream() << "hello\r\nworld\033[1;8Hx\033[3;2Hy\033[Az\bZ";
+	t = es.flush();
+	screen.apply(t);
+	UE_TEST_ASSERT("hello  x\nwoZld\n y\n", screen.toStdString());
+	UE_TEST_ASSERT(1, screen.getCursorRow());
+	UE_TEST_ASSERT(3, screen.getCursorCol());
+
+	// only the cells changed since the damage was cleared are reported
+	screen.clearDamage();
+	UE_TEST_ASSERT(true, screen.getDamage().empty());
+	es.stream() << "\033[4;3Hab\033[2;9H\033[K";
+	t = es.flush();
+	screen.apply(t);
+	UE_TEST_ASSERT(true, screen.getRowDamage(0).empty());
+	UE_TEST_ASSERT(8, screen.getRowDamage(1).left);
+	UE_TEST_ASSERT(10, screen.getRowDamage(1).right);
+	UE_TEST_ASSERT(2, screen.getRowDamage(3).left);
+	UE_TEST_ASSERT(4, screen.getRowDamage(3).right);
+	Screen::Rect damage = screen.getDamage();
+	UE_TEST_ASSERT(1, damage.top);
+	UE_TEST_ASSERT(4, damage.bottom);
+	UE_TEST_ASSERT(2, damage.left);
+	UE_TEST_ASSERT(10, damage.right);
+
+	// characters are written with the current rendition, which is saved and restored with the cursor
+	es.stream() << "\033[2J\033[1;1H\033[1;31mR\033[s\033[0mN\033[u\033[4mU";
+	t = es.flush();
+	screen.apply(t);
+	UE_TEST_ASSERT("RU", screen.getRowText(0));
+	UE_TEST_ASSERT((int)Rendition::Bold, (int)screen.at(0, 0).r.flags);
+	UE_TEST_ASSERT(Rendition::paletteColor(1), screen.at(0, 0).r.fg);
+	UE_TEST_ASSERT((int)(Rendition::Bold | Rendition::Underline), (int)screen.at(0, 1).r.flags);
+	UE_TEST_ASSERT(Rendition::paletteColor(1), screen.at(0, 1).r.fg);
+
+	// 256-color and RGB colors are kept, in either form
+	es.stream() << "\033[2J\033[1;1H\033[38;5;208;48;2;10;20;30mA\033[38:2::1:2:3;48:5:17mB\033[39;49mC";
+	t = es.flush();
+	screen.apply(t);
+	UE_TEST_ASSERT(Rendition::paletteColor(208), screen.at(0, 0).r.fg);
+	UE_TEST_ASSERT(Rendition::rgbColor(10, 20, 30), screen.at(0, 0).r.bg);
+	UE_TEST_ASSERT(Rendition::rgbColor(1, 2, 3), screen.at(0, 1).r.fg);
+	UE_TEST_ASSERT(Rendition::paletteColor(17), screen.at(0, 1).r.bg);
+	UE_TEST_ASSERT((int)Rendition::DefaultColor, (int)Rendition::getColorKind(screen.at(0, 2).r.fg));
+	UE_TEST_ASSERT(Rendition::defaultColor, screen.at(0, 2).r.bg);
+
+	// long lines wrap, and line feeds at the bottom push lines into the scrollback ring
+	es.stream() << "\033[0m\033[2J\033[1;1Habcdefghij0123456789\r\nA\r\nB\r\nC\r\nD";
+	t = es.flush();
+	screen.apply(t);
+	UE_TEST_ASSERT("A\nB\nC\nD", screen.toStdString());
+	UE_TEST_ASSERT(2, screen.getScrollbackSize());
+	UE_TEST_ASSERT(U'a', screen.getScrollbackRow(0)[0].c);
+	UE_TEST_ASSERT(U'0', screen.getScrollbackRow(1)[0].c);
+	es.stream() << "\r\nE";
+	t = es.flush();
+	screen.apply(t);
+	UE_TEST_ASSERT(2, screen.getScrollbackSize());
+	UE_TEST_ASSERT(U'0', screen.getScrollbackRow(0)[0].c);
+	UE_TEST_ASSERT(U'A', screen.getScrollbackRow(1)[0].c);
+
+	// scroll escapes move the screen without touching the scrollback
+	es.stream() << "\033[2T";
+	t = es.flush();
+	screen.apply(t);
+	UE_TEST_ASSERT("\n\nB\nC", screen.toStdString());
+	es.stream() << "\033[3S";
+	t = es.flush();
+	screen.apply(t);
+	UE_TEST_ASSERT("C\n\n\n", screen.toStdString());
+	UE_TEST_ASSERT(2, screen.getScrollbackSize());
+
+	// the cursor can be hidden, and a parallel flush applies like a serial one
+	es.stream() << "\033[?25l\033[1;1H\033[2Kpar\033[1Kx";
+	AttributeRope<EscapeStream::Attribute> rope = es.flushParallel(WorkPool::shared(), 3);
+	screen.apply(rope);
+	UE_TEST_ASSERT(false, screen.isCursorVisible());
+	UE_TEST_ASSERT("   x", screen.getRowText(0));
+
+	// UTF-8 text takes as many columns as on a terminal: wide characters take two cells, the
+	// second of them a wideTail
+	Screen wide(3, 8, 0);
+	string words[] = {"caf\xc3\xa9", "\xce\xb1\xcf\x81\xcf\x87\xce\xb5\xce\xaf\xce\xbf", "\xe6\x9e\x84\xe5\xbb\xba", "\xf0\x9f\x9a\x80\xe2\x9c\x94"};
+	es.stream() << words[0] << "\033[31m\r\n" << words[1] << "\r\n" << words[2] << " " << words[3];
+	t = es.flush();
+	wide.apply(t);
+	UE_TEST_ASSERT(words[0] + "\n" + words[1] + "\n" + words[2] + " " + words[3], wide.toStdString());
+	UE_TEST_ASSERT(0x00e9, (unsigned)wide.at(0, 3).c);
+	UE_TEST_ASSERT(0x5efa, (unsigned)wide.at(2, 2).c);
+	UE_TEST_ASSERT((unsigned)Screen::wideTail, (unsigned)wide.at(2, 3).c);
+	UE_TEST_ASSERT(0x1f680, (unsigned)wide.at(2, 5).c);
+	UE_TEST_ASSERT(0x2714, (unsigned)wide.at(2, 7).c);
+	UE_TEST_ASSERT(Rendition::paletteColor(1), wide.at(1, 0).r.fg);
+	UE_TEST_ASSERT(2, wide.getCursorRow());
+	UE_TEST_ASSERT(7, wide.getCursorCol());
+
+	// wide characters wrap whole, and ill-formed bytes show as U+FFFD
+	wide.write("\033\xe4\xb8\xad\xe6\x96\x87\xe4\xb8\xad\xe6\x96\x87\xc3");
+	UE_TEST_ASSERT(words[2] + " " + words[3], wide.getRowText(0));
+	UE_TEST_ASSERT("\xe4\xb8\xad\xe6\x96\x87\xe4\xb8\xad\xe6\x96\x87", wide.getRowText(1));
+	UE_TEST_ASSERT("\xef\xbf\xbd", wide.getRowText(2));
+	es.stream() << "\033[2;8H\xe6\x9e\x84\xe5\xbb\xba";
+	t = es.flush();
+	wide.apply(t);
+	UE_TEST_ASSERT("\xe4\xb8\xad\xe6\x96\x87\xe4\xb8\xad\xe6\x96\x87", wide.getRowText(1));
+	UE_TEST_ASSERT(words[2], wide.getRowText(2));
+
+	// combining marks and joiners take no column, and stay with the character before them
+	UE_TEST_ASSERT("1 1 2 2 0 0 -1", to_string(getCharWidth('a')) + " " + to_string(getCharWidth(0xe9)) + " " + to_string(getCharWidth(0x4e2d)) + " " + to_string(getCharWidth(0x1f680)) + " " + to_string(getCharWidth(0x0301)) + " " + to_string(getCharWidth(0x200d)) + " " + to_string(getCharWidth('\n')));
+	Screen marks(2, 10, 0);
+	marks.write("e\xcc\x81\xcc\xa3x\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9!");
+	UE_TEST_ASSERT("e\xcc\x81\xcc\xa3x\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9!", marks.getRowText(0));
+	UE_TEST_ASSERT(0x0301, (unsigned)marks.at(0, 0).marks[0]);
+	UE_TEST_ASSERT((int)'x', (int)marks.at(0, 1).c);
+	UE_TEST_ASSERT(0x200d, (unsigned)marks.at(0, 2).marks[0]);
+	UE_TEST_ASSERT((int)'!', (int)marks.at(0, 6).c);
+	UE_TEST_ASSERT(7, marks.getCursorCol());
+
+	// cursor addressing counts columns, and a wide character cut by a write or an erase goes whole
+	Screen cut(1, 10, 0);
+	cut.write("\xe6\x9e\x84\xe5\xbb\xba" "ab");
+	UE_TEST_ASSERT(6, cut.getCursorCol());
+	es.stream() << "\033[1;2Hx\033[1;4H\033[K";
+	t = es.flush();
+	cut.apply(t);
+	UE_TEST_ASSERT(" x", cut.getRowText(0));
+}
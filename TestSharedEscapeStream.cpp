@@ -0,0 +1,87 @@
+#include "SharedEscapeStream.h"
+#include <thread>
+
+using namespace unixescape;
+
+// the text of t, with control characters kept and other escapes written as their first argument in brackets
+string describe(AttributeText<EscapeStream::Attribute> &t)
+{
+	string rtn;
+	EscapeStream::visit(t, [&](string_view s) { rtn.append(s.data(), s.size()); },
+		[&](const EscapeStream::Attribute &a) {
+			if (a.getOpcode() == EscapeStream::Attribute::Control)
+				rtn.append(a.getEscape().data(), a.getEscape().size());
+			else
+				rtn += "[" + to_string(a.getParam(0)) + "]";
+		});
+	return rtn;
+}
+
+int main()
+{
+	UE_TEST_HEADER("SharedEscapeStream");
+
+	// the writes of every thread arrive whole and in order
+	{
+		SharedEscapeStream s(256);
+		vector<thread> threads;
+		for (int t = 0; t < 4; t++)
+		{
+			threads.push_back(thread([&s, t]() {
+				for (int i = 0; i < 500; i++)
+					s.write("\033[3" + to_string(t) + "m" + to_string(t) + ":" + to_string(i) + "\n");
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+		s.close();
+
+		string all;
+		size_t texts = 0;
+		AttributeText<EscapeStream::Attribute> t;
+		while (s.read(t))
+		{
+			all += describe(t);
+			texts++;
+		}
+		UE_TEST_ASSERT(true, (texts > 0));
+		UE_TEST_ASSERT(2000, count(all.begin(), all.end(), '\n'));
+
+		int next[4] = {0, 0, 0, 0};
+		bool ordered = true;
+		stringstream lines(all);
+		string line;
+		while (getline(lines, line))
+		{
+			int w = line[2]-'0';
+			ordered = ordered && (line == "[3" + to_string(w) + "]" + to_string(w) + ":" + to_string(next[w]));
+			next[w]++;
+		}
+		UE_TEST_ASSERT(true, ordered);
+		UE_TEST_ASSERT(500, next[3]);
+	}
+
+	// sync() waits for the writes made before it, and read() need not wait
+	{
+		SharedEscapeStream s;
+		AttributeText<EscapeStream::Attribute> t;
+		UE_TEST_ASSERT(false, s.read(t, false));
+		s.write(string_view("a\033[1mb"));
+		s.write(string("c"));
+		s.sync();
+		string got;
+		while (s.read(t, false))
+			got += describe(t);
+		UE_TEST_ASSERT("a[1]bc", got);
+
+		// once closed, writes are refused and reading ends after the last text
+		s.write("d");
+		s.close();
+		UE_TEST_ASSERT(false, s.write("e"));
+		UE_TEST_ASSERT(true, s.read(t));
+		UE_TEST_ASSERT("d", describe(t));
+		UE_TEST_ASSERT(false, s.read(t));
+	}
+
+	return 0;
+}
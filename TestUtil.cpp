@@ -0,0 +1,50 @@
+#include "Util.h"
+
+using namespace unixescape;
+
+int main()
+{
+	UE_TEST_HEADER("Util");
+
+	// single bytes are shown for debugging, and whole strings escaped so they can be read back
+	UE_TEST_ASSERT("a", makeCharPrintable('a'));
+	UE_TEST_ASSERT("\\x1b", makeCharPrintable('\033'));
+	UE_TEST_ASSERT("\\xa", makeCharPrintable('\n'));
+	UE_TEST_ASSERT("\\xe9", makeCharPrintable('\xe9'));
+	UE_TEST_ASSERT("a\\x1b[1mb\\\\n\\x0a\\xc3\\xa9", makeCharsPrintable("a\033[1mb\\n\n\xc3\xa9"));
+
+	// the text between escapes is copied in runs, whatever its length
+	string line;
+	for (int i = 0; i < 100; i++)
+		line += string(i%40, 'x')+"\033[3"+to_string(i%8)+"m\\\t";
+	string printable = makeCharsPrintable(line);
+	UE_TEST_ASSERT(string::npos, printable.find('\033'));
+	UE_TEST_ASSERT(line, replaceEscapes(printable));
+
+	// escape sequences are replaced by the bytes they stand for
+	UE_TEST_ASSERT("\a\b\f\n\r\t\v'\"?\\", replaceEscapes("\\a\\b\\f\\n\\r\\t\\v\\'\\\"\\?\\\\"));
+	UE_TEST_ASSERT("\033[1m\033[0m\0337!", replaceEscapes("\\x1b[1m\\033[0m\\0337\\x21"));
+	UE_TEST_ASSERT("\x0fg", replaceEscapes("\\xfg"));
+	UE_TEST_ASSERT("ab", replaceEscapes("a\\qb\\"));
+
+	// the buffer versions append, or work in place
+	string out = "> ";
+	UE_TEST_ASSERT(3, replaceEscapes("a\\nb", out));
+	UE_TEST_ASSERT("> a\nb", out);
+	UE_TEST_ASSERT(5, makeCharsPrintable("\033c", out));
+	UE_TEST_ASSERT("> a\nb\\x1bc", out);
+	char buf[] = "tab\\there\\x21";
+	UE_TEST_ASSERT(9, replaceEscapes(buf, strlen(buf), buf)-buf);
+	UE_TEST_ASSERT("tab\there!", string(buf, 9));
+
+	// the string versions accept their own output as input, and inputs longer than their buffer
+	out = "\\t\x01";
+	UE_TEST_ASSERT(7, makeCharsPrintable(out, out));
+	UE_TEST_ASSERT("\\t\x01" "\\\\t\\x01", out);
+	UE_TEST_ASSERT(3, replaceEscapes(string_view(out).substr(3), out));
+	UE_TEST_ASSERT("\\t\x01" "\\\\t\\x01" "\\t\x01", out);
+	string big(5000, '\001');
+	out.clear();
+	UE_TEST_ASSERT(20000, makeCharsPrintable(big, out));
+	UE_TEST_ASSERT(big, replaceEscapes(out));
+}
@@ -0,0 +1,300 @@
+#include "Utf8.h"
+
+namespace unixescape
+{
+	namespace
+	{
+		typedef struct Range
+		{
+			char32_t first, last;
+		} Range;
+
+		// code points with the Grapheme_Extend or SpacingMark property, in the common blocks
+		const Range extend[] = {
+			{0x0300, 0x036f}, {0x0483, 0x0489}, {0x0591, 0x05bd}, {0x05bf, 0x05bf}, {0x05c1, 0x05c2},
+			{0x05c4, 0x05c5}, {0x05c7, 0x05c7}, {0x0610, 0x061a}, {0x064b, 0x065f}, {0x0670, 0x0670},
+			{0x06d6, 0x06dc}, {0x06df, 0x06e4}, {0x06e7, 0x06e8}, {0x06ea, 0x06ed}, {0x0900, 0x0903},
+			{0x093a, 0x093c}, {0x093e, 0x094f}, {0x0951, 0x0957}, {0x0962, 0x0963}, {0x0981, 0x0983},
+			{0x09bc, 0x09bc}, {0x09be, 0x09cd}, {0x0e31, 0x0e31}, {0x0e34, 0x0e3a}, {0x0e47, 0x0e4e},
+			{0x0eb1, 0x0eb1}, {0x0eb4, 0x0ebc}, {0x0ec8, 0x0ecd}, {0x1ab0, 0x1aff}, {0x1dc0, 0x1dff},
+			{0x200c, 0x200c}, {0x20d0, 0x20ff}, {0x302a, 0x302f}, {0x3099, 0x309a}, {0xfe00, 0xfe0f},
+			{0xfe20, 0xfe2f}, {0x1f3fb, 0x1f3ff}, {0xe0020, 0xe007f}, {0xe0100, 0xe01ef}};
+
+		// code points with the Extended_Pictographic property, in the common blocks
+		const Range pictographic[] = {
+			{0x00a9, 0x00a9}, {0x00ae, 0x00ae}, {0x203c, 0x203c}, {0x2049, 0x2049}, {0x2122, 0x2122},
+			{0x2139, 0x2139}, {0x2194, 0x21aa}, {0x231a, 0x23ff}, {0x24c2, 0x24c2}, {0x25aa, 0x25fe},
+			{0x2600, 0x27bf}, {0x2934, 0x2935}, {0x2b05, 0x2b55}, {0x3030, 0x3030}, {0x303d, 0x303d},
+			{0x3297, 0x3299}, {0x1f000, 0x1f0ff}, {0x1f10d, 0x1f1ad}, {0x1f201, 0x1f3fa}, {0x1f400, 0x1faff}};
+
+		// code points which take no column: nonspacing and enclosing marks, format characters and
+		// Hangul medial and final jamo, in the common blocks
+		const Range zeroWidth[] = {
+			{0x0300, 0x036f}, {0x0483, 0x0489}, {0x0591, 0x05bd}, {0x05bf, 0x05bf}, {0x05c1, 0x05c2},
+			{0x05c4, 0x05c5}, {0x05c7, 0x05c7}, {0x0610, 0x061a}, {0x061c, 0x061c}, {0x064b, 0x065f},
+			{0x0670, 0x0670}, {0x06d6, 0x06dc}, {0x06df, 0x06e4}, {0x06e7, 0x06e8}, {0x06ea, 0x06ed},
+			{0x0711, 0x0711}, {0x0730, 0x074a}, {0x0900, 0x0902}, {0x093a, 0x093a}, {0x093c, 0x093c},
+			{0x0941, 0x0948}, {0x094d, 0x094d}, {0x0951, 0x0957}, {0x0962, 0x0963}, {0x0981, 0x0981},
+			{0x09bc, 0x09bc}, {0x09c1, 0x09c4}, {0x09cd, 0x09cd}, {0x0e31, 0x0e31}, {0x0e34, 0x0e3a},
+			{0x0e47, 0x0e4e}, {0x0eb1, 0x0eb1}, {0x0eb4, 0x0ebc}, {0x0ec8, 0x0ecd}, {0x1160, 0x11ff},
+			{0x1ab0, 0x1aff}, {0x1dc0, 0x1dff}, {0x200b, 0x200f}, {0x202a, 0x202e}, {0x2060, 0x2064},
+			{0x20d0, 0x20ff}, {0x302a, 0x302d}, {0x3099, 0x309a}, {0xfe00, 0xfe0f}, {0xfe20, 0xfe2f},
+			{0xfeff, 0xfeff}, {0xe0001, 0xe0001}, {0xe0020, 0xe007f}, {0xe0100, 0xe01ef}};
+
+		// code points with the East_Asian_Width property Wide or Fullwidth, which take two columns
+		const Range wide[] = {
+			{0x1100, 0x115f}, {0x231a, 0x231b}, {0x2329, 0x232a}, {0x23e9, 0x23ec}, {0x23f0, 0x23f0},
+			{0x23f3, 0x23f3}, {0x25fd, 0x25fe}, {0x2614, 0x2615}, {0x2648, 0x2653}, {0x267f, 0x267f},
+			{0x2693, 0x2693}, {0x26a1, 0x26a1}, {0x26aa, 0x26ab}, {0x26bd, 0x26be}, {0x26c4, 0x26c5},
+			{0x26ce, 0x26ce}, {0x26d4, 0x26d4}, {0x26ea, 0x26ea}, {0x26f2, 0x26f3}, {0x26f5, 0x26f5},
+			{0x26fa, 0x26fa}, {0x26fd, 0x26fd}, {0x2705, 0x2705}, {0x270a, 0x270b}, {0x2728, 0x2728},
+			{0x274c, 0x274c}, {0x274e, 0x274e}, {0x2753, 0x2755}, {0x2757, 0x2757}, {0x2795, 0x2797},
+			{0x27b0, 0x27b0}, {0x27bf, 0x27bf}, {0x2b1b, 0x2b1c}, {0x2b50, 0x2b50}, {0x2b55, 0x2b55},
+			{0x2e80, 0x303e}, {0x3041, 0x33ff}, {0x3400, 0x4dbf}, {0x4e00, 0x9fff}, {0xa000, 0xa4cf},
+			{0xa960, 0xa97f}, {0xac00, 0xd7a3}, {0xf900, 0xfaff}, {0xfe10, 0xfe19}, {0xfe30, 0xfe6f},
+			{0xff00, 0xff60}, {0xffe0, 0xffe6}, {0x16fe0, 0x16fe4}, {0x17000, 0x18aff}, {0x1b000, 0x1b2ff},
+			{0x1f004, 0x1f004}, {0x1f0cf, 0x1f0cf}, {0x1f18e, 0x1f18e}, {0x1f191, 0x1f19a}, {0x1f200, 0x1f202},
+			{0x1f210, 0x1f23b}, {0x1f240, 0x1f248}, {0x1f250, 0x1f251}, {0x1f260, 0x1f265}, {0x1f300, 0x1f320},
+			{0x1f32d, 0x1f335}, {0x1f337, 0x1f37c}, {0x1f37e, 0x1f393}, {0x1f3a0, 0x1f3ca}, {0x1f3cf, 0x1f3d3},
+			{0x1f3e0, 0x1f3f0}, {0x1f3f4, 0x1f3f4}, {0x1f3f8, 0x1f43e}, {0x1f440, 0x1f440}, {0x1f442, 0x1f4fc},
+			{0x1f4ff, 0x1f53d}, {0x1f54b, 0x1f54e}, {0x1f550, 0x1f567}, {0x1f57a, 0x1f57a}, {0x1f595, 0x1f596},
+			{0x1f5a4, 0x1f5a4}, {0x1f5fb, 0x1f64f}, {0x1f680, 0x1f6c5}, {0x1f6cc, 0x1f6cc}, {0x1f6d0, 0x1f6d2},
+			{0x1f6d5, 0x1f6d7}, {0x1f6eb, 0x1f6ec}, {0x1f6f4, 0x1f6fc}, {0x1f7e0, 0x1f7eb}, {0x1f90c, 0x1f93a},
+			{0x1f93c, 0x1f945}, {0x1f947, 0x1f9ff}, {0x1fa70, 0x1faff}, {0x20000, 0x2fffd}, {0x30000, 0x3fffd}};
+
+		const char32_t zeroWidthJoiner = 0x200d;
+
+		template<size_t N> bool inRanges(char32_t cp, const Range (&ranges)[N])
+		{
+			size_t lo = 0, hi = N;
+			while (lo < hi)
+			{
+				size_t mid = (lo+hi)/2;
+				if (ranges[mid].last < cp)
+					lo = mid+1;
+				else
+					hi = mid;
+			}
+			return (lo < N && ranges[lo].first <= cp);
+		}
+
+		inline bool isControl(char32_t cp)
+		{
+			return (cp < 0x20 || (cp >= 0x7f && cp < 0xa0) || cp == 0x2028 || cp == 0x2029);
+		}
+
+		inline bool isRegional(char32_t cp)
+		{
+			return (cp >= 0x1f1e6 && cp <= 0x1f1ff);
+		}
+	}
+
+	int checkUtf8(const char *s, size_t n)
+	{
+		const unsigned char *p = (const unsigned char *)s;
+		unsigned char c = p[0];
+
+		// the length and the allowed range of the second byte, from Table 3-7 of the Unicode Standard
+		size_t len;
+		unsigned char lo = 0x80, hi = 0xbf;
+		if (c >= 0xc2 && c <= 0xdf)
+			len = 2;
+		else if (c >= 0xe0 && c <= 0xef)
+			len = 3;
+		else if (c >= 0xf0 && c <= 0xf4)
+			len = 4;
+		else
+			return 0;
+
+		if (c == 0xe0)
+			lo = 0xa0;
+		else if (c == 0xed)
+			hi = 0x9f;
+		else if (c == 0xf0)
+			lo = 0x90;
+		else if (c == 0xf4)
+			hi = 0x8f;
+
+		for (size_t i = 1; i < len; i++)
+		{
+			if (i == n)
+				return -(int)n;
+			if (p[i] < lo || p[i] > hi)
+				return 0;
+			lo = 0x80;
+			hi = 0xbf;
+		}
+		return (int)len;
+	}
+
+	size_t decodeUtf8(const char *s, size_t n, char32_t &cp)
+	{
+		const unsigned char *p = (const unsigned char *)s;
+		if (p[0] < 0x80)
+		{
+			cp = p[0];
+			return 1;
+		}
+
+		int len = checkUtf8(s, n);
+		if (len <= 0)
+		{
+			cp = replacementCharacter;
+			return 1;
+		}
+
+		cp = p[0] & (0x7f >> len);
+		for (int i = 1; i < len; i++)
+			cp = (cp << 6) | (p[i] & 0x3f);
+		return len;
+	}
+
+	size_t encodeUtf8(char32_t cp, char *out)
+	{
+		unsigned char *p = (unsigned char *)out;
+		if (cp < 0x80)
+		{
+			p[0] = (unsigned char)cp;
+			return 1;
+		}
+		if (cp < 0x800)
+		{
+			p[0] = (unsigned char)(0xc0 | (cp >> 6));
+			p[1] = (unsigned char)(0x80 | (cp & 0x3f));
+			return 2;
+		}
+		if ((cp >= 0xd800 && cp < 0xe000) || cp > 0x10ffff)
+			cp = replacementCharacter;
+		if (cp < 0x10000)
+		{
+			p[0] = (unsigned char)(0xe0 | (cp >> 12));
+			p[1] = (unsigned char)(0x80 | ((cp >> 6) & 0x3f));
+			p[2] = (unsigned char)(0x80 | (cp & 0x3f));
+			return 3;
+		}
+		p[0] = (unsigned char)(0xf0 | (cp >> 18));
+		p[1] = (unsigned char)(0x80 | ((cp >> 12) & 0x3f));
+		p[2] = (unsigned char)(0x80 | ((cp >> 6) & 0x3f));
+		p[3] = (unsigned char)(0x80 | (cp & 0x3f));
+		return 4;
+	}
+
+	int getCharWidth(char32_t cp)
+	{
+		// ASCII is the common case
+		if (cp >= 0x20 && cp < 0x7f)
+			return 1;
+		if (isControl(cp))
+			return -1;
+		if (inRanges(cp, zeroWidth))
+			return 0;
+		return inRanges(cp, wide) ? 2 : 1;
+	}
+
+	bool isGraphemeBreak(char32_t prev, char32_t next, GraphemeState &state)
+	{
+		if (inRanges(prev, pictographic))
+			state.pictographic = true;
+		else if (!inRanges(prev, extend) && prev != zeroWidthJoiner)
+			state.pictographic = false;
+		state.regional = isRegional(prev) ? state.regional+1 : 0;
+
+		// GB3-GB5: CR LF stays together, other controls stand alone
+		if (prev == '\r' && next == '\n')
+			return false;
+		if (isControl(prev) || isControl(next))
+			return true;
+
+		// GB9: extending code points and joiners attach to what precedes them
+		if (inRanges(next, extend) || next == zeroWidthJoiner)
+			return false;
+
+		// GB11: an emoji, extenders, a joiner and another emoji form one cluster
+		if (prev == zeroWidthJoiner && state.pictographic && inRanges(next, pictographic))
+			return false;
+
+		// GB12-GB13: regional indicators pair up into flags
+		if (isRegional(prev) && isRegional(next))
+			return (state.regional%2 == 0);
+
+		return true;
+	}
+
+	void CodePointIterator::load()
+	{
+		while (cp.pos < n && s[cp.pos] == 0)
+			cp.pos++;
+		if (cp.pos == n)
+		{
+			s = NULL;
+			n = 0;
+			cp.pos = 0;
+			cp.size = 0;
+			return ;
+		}
+
+		cp.size = decodeUtf8(s+cp.pos, n-cp.pos, cp.value);
+	}
+
+	CodePointIterator &CodePointIterator::operator ++ ()
+	{
+		cp.pos += cp.size;
+		load();
+		return *this;
+	}
+
+	CodePointIterator CodePointIterator::operator ++ (int)
+	{
+		CodePointIterator tmp = *this;
+		++*this;
+		return tmp;
+	}
+
+	bool CodePointIterator::operator == (const CodePointIterator &i) const
+	{
+		return (s == i.s && cp.pos == i.cp.pos);
+	}
+
+	void GraphemeIterator::load()
+	{
+		if (first == CodePointIterator())
+			return ;
+
+		GraphemeState state;
+		CodePoint last = *first;
+		g.pos = last.pos;
+		g.codePoints = 1;
+		for (next = first, ++next; next != CodePointIterator() && !isGraphemeBreak(last.value, next->value, state); ++next)
+		{
+			last = *next;
+			g.codePoints++;
+		}
+		g.size = last.pos+last.size-g.pos;
+	}
+
+	GraphemeIterator &GraphemeIterator::operator ++ ()
+	{
+		first = next;
+		load();
+		return *this;
+	}
+
+	GraphemeIterator GraphemeIterator::operator ++ (int)
+	{
+		GraphemeIterator tmp = *this;
+		++*this;
+		return tmp;
+	}
+
+	CodePointRange codePoints(std::string_view s)
+	{
+		CodePointRange r = {CodePointIterator(s)};
+		return r;
+	}
+
+	GraphemeRange graphemes(std::string_view s)
+	{
+		GraphemeRange r = {GraphemeIterator(s)};
+		return r;
+	}
+}
@@ -0,0 +1,192 @@
+/* Copyright 2013 Oliver Katz
+ *
+ * This file is part of LibUNIXEscape.
+ *
+ * LibUNIXEscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LibUNIXEscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LibUNIXEscape.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file Utf8.h
+ *  \brief UTF-8 decoding and grapheme cluster boundaries, used by the parser and by the code point
+ *  and grapheme iterators of AttributeText. */
+
+#ifndef __LIB_UNIX_ESCAPE_UTF8_H
+#define __LIB_UNIX_ESCAPE_UTF8_H
+
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+
+/*! Namespace for all LibUNIXEscape classes/methods/global variables. */
+namespace unixescape
+{
+	/*! Code point returned by decodeUtf8() for ill-formed bytes. */
+	const char32_t replacementCharacter = 0xfffd;
+
+	/*! Checks the UTF-8 sequence starting with the byte \a s[0] (at least 0x80), of which \a n bytes
+	 *  are available. Returns its length if it is complete and well-formed, minus \a n if the \a n
+	 *  bytes are the well-formed start of a sequence cut off by the end of \a s, or 0 if it is
+	 *  ill-formed (an overlong form, a surrogate, above U+10FFFF, or a lone continuation byte). */
+	int checkUtf8(const char *s, size_t n);
+
+	/*! Decodes the code point at the start of \a s (\a n > 0 bytes) into \a cp, and returns the
+	 *  number of bytes it takes. An ill-formed or cut-off sequence decodes as one
+	 *  replacementCharacter per byte. */
+	size_t decodeUtf8(const char *s, size_t n, char32_t &cp);
+
+	/*! Writes the UTF-8 encoding of \a cp to \a out, which must have room for 4 bytes, and
+	 *  returns its length. A surrogate or a value above U+10FFFF is written as replacementCharacter. */
+	size_t encodeUtf8(char32_t cp, char *out);
+
+	/*! Returns the number of terminal columns the code point \a cp takes, as wcwidth() does:
+	 *  2 for East Asian wide and fullwidth characters (CJK, most emoji), 0 for combining marks,
+	 *  joiners and other format characters, -1 for control characters and 1 for the rest. The
+	 *  tables cover the commonly used blocks rather than all of Unicode. */
+	int getCharWidth(char32_t cp);
+
+	/*! Keeps what grapheme cluster boundaries depend on besides the two code points around them. */
+	typedef struct GraphemeState
+	{
+		/*! Number of regional indicators in a row before the boundary. */
+		size_t regional;
+
+		/*! True if the cluster so far is an emoji followed by extending code points. */
+		bool pictographic;
+
+		/*! Constructor. */
+		GraphemeState() : regional(0), pictographic(false) {}
+	} GraphemeState;
+
+	/*! Returns true if there is a grapheme cluster boundary between the code points \a prev and
+	 *  \a next, and updates \a state, which should start default-constructed at each cluster.
+	 *  Follows the rules of Unicode Standard Annex #29 for CR LF, controls, combining marks and
+	 *  other extending code points, zero-width joiner emoji sequences and regional indicator
+	 *  (flag) pairs; Hangul syllables and the Indic conjunct rule are not handled, and the property
+	 *  tables cover the commonly used blocks rather than all of Unicode. */
+	bool isGraphemeBreak(char32_t prev, char32_t next, GraphemeState &state);
+
+	/*! A character of a UTF-8 string, as produced by CodePointIterator. */
+	typedef struct CodePoint
+	{
+		/*! Index of its first byte in the string. */
+		size_t pos;
+
+		/*! Number of bytes it takes. */
+		size_t size;
+
+		/*! The code point (replacementCharacter for an ill-formed byte). */
+		char32_t value;
+	} CodePoint;
+
+	/*! Forward iterator over the code points of a UTF-8 string. 0 bytes (the placeholders of
+	 *  AttributeText::chars()) are skipped. */
+	class CodePointIterator
+	{
+		const char *s;
+		size_t n;
+		CodePoint cp;
+
+		void load();
+
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef CodePoint value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const CodePoint *pointer;
+		typedef const CodePoint &reference;
+
+		/*! Constructor (end iterator). */
+		CodePointIterator() : s(NULL), n(0), cp{0, 0, 0} {}
+
+		/*! Constructor. */
+		CodePointIterator(std::string_view v) : s(v.data()), n(v.size()), cp{0, 0, 0} { load(); }
+
+		reference operator * () const { return cp; }
+		pointer operator -> () const { return &cp; }
+		CodePointIterator &operator ++ ();
+		CodePointIterator operator ++ (int);
+		bool operator == (const CodePointIterator &i) const;
+		bool operator != (const CodePointIterator &i) const { return !(*this == i); }
+	};
+
+	/*! Range of code points returned by codePoints(), for use with range-based for loops. */
+	typedef struct CodePointRange
+	{
+		CodePointIterator first;
+
+		CodePointIterator begin() const { return first; }
+		CodePointIterator end() const { return CodePointIterator(); }
+	} CodePointRange;
+
+	/*! A user-perceived character (grapheme cluster) of a UTF-8 string, as produced by
+	 *  GraphemeIterator. */
+	typedef struct Grapheme
+	{
+		/*! Index of its first byte in the string. */
+		size_t pos;
+
+		/*! Number of bytes from its first byte to its last, including any 0 bytes in between. */
+		size_t size;
+
+		/*! Number of code points. */
+		size_t codePoints;
+	} Grapheme;
+
+	/*! Forward iterator over the grapheme clusters of a UTF-8 string, as cut by isGraphemeBreak().
+	 *  0 bytes are skipped, so a cluster continues across the placeholders of AttributeText::chars(). */
+	class GraphemeIterator
+	{
+		CodePointIterator first;
+		CodePointIterator next;
+		Grapheme g;
+
+		void load();
+
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef Grapheme value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const Grapheme *pointer;
+		typedef const Grapheme &reference;
+
+		/*! Constructor (end iterator). */
+		GraphemeIterator() : g{0, 0, 0} {}
+
+		/*! Constructor. */
+		GraphemeIterator(std::string_view v) : first(v), g{0, 0, 0} { load(); }
+
+		reference operator * () const { return g; }
+		pointer operator -> () const { return &g; }
+		GraphemeIterator &operator ++ ();
+		GraphemeIterator operator ++ (int);
+		bool operator == (const GraphemeIterator &i) const { return first == i.first; }
+		bool operator != (const GraphemeIterator &i) const { return !(*this == i); }
+	};
+
+	/*! Range of grapheme clusters returned by graphemes(), for use with range-based for loops. */
+	typedef struct GraphemeRange
+	{
+		GraphemeIterator first;
+
+		GraphemeIterator begin() const { return first; }
+		GraphemeIterator end() const { return GraphemeIterator(); }
+	} GraphemeRange;
+
+	/*! Returns the code points of \a s. */
+	CodePointRange codePoints(std::string_view s);
+
+	/*! Returns the grapheme clusters of \a s. */
+	GraphemeRange graphemes(std::string_view s);
+}
+
+#endif
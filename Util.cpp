@@ -1,112 +1,239 @@
 #include "Util.h"
+#include "Scan.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace unixescape
 {
-	string makeCharPrintable(char c)
+	namespace
 	{
-		stringstream ss;
+		const char hexDigits[] = "0123456789abcdef";
 
-		if (isprint(c))
-		{
-			ss << c;
-		}
-		else
+		inline int hexValue(char c)
 		{
-			ss << "\\x" << hex << (int)c;
+			if (c >= '0' && c <= '9')
+				return c-'0';
+			if (c >= 'a' && c <= 'f')
+				return c-'a'+10;
+			if (c >= 'A' && c <= 'F')
+				return c-'A'+10;
+			return -1;
 		}
+	}
 
-		return ss.str();
+	string makeCharPrintable(char c)
+	{
+		unsigned char b = c;
+		if (isprint(b))
+			return string(1, c);
+
+		char buf[4] = {'\\', 'x'};
+		size_t n = 2;
+		if (b >= 16)
+			buf[n++] = hexDigits[b >> 4];
+		buf[n++] = hexDigits[b & 0xf];
+		return string(buf, n);
 	}
 
-	string makeAllCharsPrintable(string s)
+	char *makeCharsPrintable(const char *s, size_t n, char *out)
 	{
-		stringstream ss;
+		const char *end = s+n;
+		while (s < end)
+		{
+			size_t run = scanUnescaped(s, end-s);
+			memcpy(out, s, run);
+			out += run;
+			s += run;
+			if (s == end)
+				break;
+
+			unsigned char b = *s++;
+			*out++ = '\\';
+			if (b == '\\')
+			{
+				*out++ = '\\';
+			}
+			else
+			{
+				*out++ = 'x';
+				*out++ = hexDigits[b >> 4];
+				*out++ = hexDigits[b & 0xf];
+			}
+		}
+		return out;
+	}
 
-		for (string::iterator i = s.begin(); i != s.end(); i++)
+	size_t makeCharsPrintable(string_view s, string &out)
+	{
+		// growing out would move s from under us if it points into it
+		if (s.data() >= out.data() && s.data() < out.data()+out.capacity())
+			return makeCharsPrintable(string(s), out);
+
+		// escape through a small buffer, rather than growing out to the worst case and zeroing it
+		static const size_t chunk = 1024;
+		char buf[4*chunk]; // maxPrintableSize(chunk)
+		size_t old = out.size();
+		out.reserve(old+s.size());
+		for (size_t i = 0; i < s.size(); i += chunk)
 		{
-			ss << makeCharPrintable(*i);
+			size_t n = min(chunk, s.size()-i);
+			out.append(buf, makeCharsPrintable(s.data()+i, n, buf)-buf);
 		}
+		return out.size()-old;
+	}
 
-		return ss.str();
+	string makeCharsPrintable(string_view s)
+	{
+		string rtn;
+		makeCharsPrintable(s, rtn);
+		return rtn;
 	}
 
-	string replaceEscapes(string s)
+	size_t maxPrintableSize(size_t n)
 	{
-		stringstream ss;
+		return 4*n;
+	}
 
-		for (string::iterator i = s.begin(); i != s.end(); i++)
+	char *replaceEscapes(const char *s, size_t n, char *out)
+	{
+		const char *end = s+n;
+		while (s < end)
 		{
-			if (*i == '\\')
+			const char *b = (const char *)memchr(s, '\\', end-s);
+			if (b == NULL)
+				b = end;
+
+			// out may be s itself, always at or before it
+			memmove(out, s, b-s);
+			out += b-s;
+			s = b;
+			if (end-s < 2)
+				break;
+
+			s++;
+			char c = *s++;
+			switch (c)
 			{
-				i++;
-				if (i == s.end())
-					break;
-
-				if (*i == 'a')
-					ss << '\a';
-				else if (*i == 'b')
-					ss << '\b';
-				else if (*i == 'f')
-					ss << '\f';
-				else if (*i == 'n')
-					ss << '\n';
-				else if (*i == 'r')
-					ss << '\r';
-				else if (*i == 't')
-					ss << '\t';
-				else if (*i == 'v')
-					ss << '\v';
-				else if (*i == '\'')
-					ss << '\'';
-				else if (*i == '\"')
-					ss << '\"';
-				else if (*i == '?')
-					ss << '?';
-				else if (*i == '\\')
-					ss << '\\';
-				else if (*i == 'x')
-				{
-					stringstream ss2;
+			case 'a': *out++ = '\a'; break;
+			case 'b': *out++ = '\b'; break;
+			case 'f': *out++ = '\f'; break;
+			case 'n': *out++ = '\n'; break;
+			case 'r': *out++ = '\r'; break;
+			case 't': *out++ = '\t'; break;
+			case 'v': *out++ = '\v'; break;
+			case '\'':
+			case '\"':
+			case '?':
+			case '\\':
+				*out++ = c;
+				break;
+
+			case 'x':
+			{
+				int v = 0, digits = 0;
+				for (int d; digits < 2 && s < end && (d = hexValue(*s)) >= 0; digits++, s++)
+					v = v*16+d;
+				if (digits > 0)
+					*out++ = (char)v;
+				break;
+			}
 
-					i++;
-					if (i == s.end())
-						break;
-					ss2 << *i;
+			default:
+				if (c >= '0' && c <= '7')
+				{
+					int v = c-'0';
+					for (int digits = 1; digits < 3 && s < end && *s >= '0' && *s <= '7'; digits++, s++)
+						v = v*8+(*s-'0');
+					*out++ = (char)v;
+				}
+				break;
+			}
+		}
+		return out;
+	}
 
-					i++;
-					if (i == s.end())
-						break;
-					ss2 << *i;
+	size_t replaceEscapes(string_view s, string &out)
+	{
+		// the result is never longer than s, so copy s and replace its escapes where it lies
+		// (append copies s correctly even if it points into out)
+		size_t old = out.size();
+		out.append(s.data(), s.size());
+		char *end = replaceEscapes(&out[old], s.size(), &out[old]);
+		out.resize(end-out.data());
+		return out.size()-old;
+	}
 
-					char c;
-					ss2 >> hex >> c;
-					ss << c;
-				}
-				else if (*i == '0')
-				{
-					stringstream ss2;
+	string replaceEscapes(string_view s)
+	{
+		string rtn;
+		replaceEscapes(s, rtn);
+		return rtn;
+	}
 
-					i++;
-					if (i == s.end())
-						break;
-					ss2 << *i;
+	MappedFile::MappedFile(const char *path) : addr(NULL), length(0), open(false)
+	{
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+		{
+			UE_ERROR("cannot open '" << path << "': " << strerror(errno));
+			return ;
+		}
 
-					i++;
-					if (i == s.end())
-						break;
-					ss2 << *i;
+		struct stat st;
+		if (fstat(fd, &st) < 0)
+		{
+			UE_ERROR("cannot stat '" << path << "': " << strerror(errno));
+			close(fd);
+			return ;
+		}
 
-					char *save;
-					char c = strtol(ss2.str().c_str(), &save, 8);
-					ss << c;
-				}
-			}
-			else
+		// an empty file can't be mapped, but is a valid (empty) input
+		length = st.st_size;
+		if (length > 0)
+		{
+			void *p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p == MAP_FAILED)
 			{
-				ss << *i;
+				UE_ERROR("cannot map '" << path << "': " << strerror(errno));
+				length = 0;
+				close(fd);
+				return ;
 			}
+			madvise(p, length, MADV_SEQUENTIAL);
+			addr = (const char *)p;
 		}
 
-		return ss.str();
+		close(fd);
+		open = true;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (addr != NULL)
+			munmap((void *)addr, length);
+	}
+
+	bool MappedFile::isOpen() const
+	{
+		return open;
+	}
+
+	const char *MappedFile::data() const
+	{
+		return addr;
+	}
+
+	size_t MappedFile::size() const
+	{
+		return length;
+	}
+
+	string_view MappedFile::view() const
+	{
+		return string_view(addr, length);
 	}
 }
@@ -63,6 +63,21 @@
 /*! \def UE_DEBUG(msg)
  *  \brief Displays a debug message to console. */
 
+/*! \def UE_TRACE(msg)
+ *  \brief Displays a trace message to console, for following the library step by step. */
+
+/*! \def UE_LOG_LEVEL
+ *  \brief The most verbose level of messages compiled in.
+ *  UE_ERROR, UE_WARNING, UE_DEBUG and UE_TRACE are compiled in only if their level
+ *  (UE_LEVEL_ERROR to UE_LEVEL_TRACE) is at most UE_LOG_LEVEL; the others expand to nothing, and
+ *  their message isn't evaluated. Defaults to UE_LEVEL_WARNING when NDEBUG is defined (release
+ *  builds) and UE_LEVEL_DEBUG otherwise; define it before including any LibUNIXEscape header (or
+ *  with -D) to choose another level. UE_FATAL is always compiled in. */
+
+/*! \def UE_MESSAGE_LOG(msg)
+ *  \brief Formats \a msg and passes it to logMessage(), which writes it to the console or to the
+ *  AsyncLog installed with AsyncLog::install(). */
+
 /*! \def UE_TEST_HEADER(name)
  *  \brief Denotes the beginning of a test.
  *  When you are testing something in a test file, use this at the beginning of a test
@@ -85,6 +100,10 @@
 #include <vector>
 #include <map>
 #include <sstream>
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+#include <memory_resource>
 
 #define UE_MESSAGE_STREAM cout
 #define UE_MESSAGE_PREFIX "[UnixEscape "<<__FILE__<<":"<<__LINE__<<"] "
@@ -92,12 +111,48 @@
 #define UE_MESSAGE_PREFIX_WARNING UE_MESSAGE_PREFIX<<"warning: "
 #define UE_MESSAGE_PREFIX_DEBUG UE_MESSAGE_PREFIX<<"debug: "
 #define UE_MESSAGE_PREFIX_TEST UE_MESSAGE_PREFIX<<"test: "
+#define UE_MESSAGE_PREFIX_TRACE UE_MESSAGE_PREFIX<<"trace: "
 #define UE_MESSAGE_DISPLAY(msg) {UE_MESSAGE_STREAM<<msg<<"\n";}
+#define UE_MESSAGE_LOG(msg) {std::stringstream _ssLog; _ssLog<<msg<<"\n"; unixescape::logMessage(_ssLog.str());}
+
+#define UE_LEVEL_ERROR 1
+#define UE_LEVEL_WARNING 2
+#define UE_LEVEL_DEBUG 3
+#define UE_LEVEL_TRACE 4
+
+#ifndef UE_LOG_LEVEL
+#ifdef NDEBUG
+#define UE_LOG_LEVEL UE_LEVEL_WARNING
+#else
+#define UE_LOG_LEVEL UE_LEVEL_DEBUG
+#endif
+#endif
+
+#define UE_FATAL(msg) {unixescape::flushLog(); UE_MESSAGE_DISPLAY(UE_MESSAGE_PREFIX_ERROR<<msg);throw std::runtime_error("internal unix escape error");}
+
+#if UE_LOG_LEVEL >= UE_LEVEL_ERROR
+#define UE_ERROR(msg) UE_MESSAGE_LOG(UE_MESSAGE_PREFIX_ERROR<<msg)
+#else
+#define UE_ERROR(msg) {}
+#endif
 
-#define UE_FATAL(msg) {UE_MESSAGE_DISPLAY(UE_MESSAGE_PREFIX_ERROR<<msg);throw std::runtime_error("internal unix escape error");}
-#define UE_ERROR(msg) {UE_MESSAGE_DISPLAY(UE_MESSAGE_PREFIX_ERROR<<msg);}
-#define UE_WARNING(msg) {UE_MESSAGE_DISPLAY(UE_MESSAGE_PREFIX_WARNING<<msg);}
-#define UE_DEBUG(msg) {UE_MESSAGE_DISPLAY(UE_MESSAGE_PREFIX_WARNING<<msg);}
+#if UE_LOG_LEVEL >= UE_LEVEL_WARNING
+#define UE_WARNING(msg) UE_MESSAGE_LOG(UE_MESSAGE_PREFIX_WARNING<<msg)
+#else
+#define UE_WARNING(msg) {}
+#endif
+
+#if UE_LOG_LEVEL >= UE_LEVEL_DEBUG
+#define UE_DEBUG(msg) UE_MESSAGE_LOG(UE_MESSAGE_PREFIX_DEBUG<<msg)
+#else
+#define UE_DEBUG(msg) {}
+#endif
+
+#if UE_LOG_LEVEL >= UE_LEVEL_TRACE
+#define UE_TRACE(msg) UE_MESSAGE_LOG(UE_MESSAGE_PREFIX_TRACE<<msg)
+#else
+#define UE_TRACE(msg) {}
+#endif
 
 #define UE_TEST_HEADER(name) {UE_MESSAGE_DISPLAY(UE_MESSAGE_PREFIX_TEST<<"running '"<<name<<"'");}
 #define UE_TEST_ASSERT(expected, recieved) { \
@@ -120,9 +175,87 @@ namespace unixescape
 {
 	using namespace std;
 
+	/*! Writes the formatted message \a s (ending with a newline) to the AsyncLog installed with
+	 *  AsyncLog::install(), or else straight to UE_MESSAGE_STREAM. Used by UE_ERROR, UE_WARNING,
+	 *  UE_DEBUG and UE_TRACE. */
+	void logMessage(const string &s);
+
+	/*! Waits until the installed AsyncLog, if any, has written every message given to it so far. */
+	void flushLog();
+
+	/*! Returns \a c if it is printable ASCII, or a \\x escape of its value, for displaying single
+	 *  bytes. */
 	string makeCharPrintable(char c);
-	string makeCharsPrintable(string s);
-	string replaceEscapes(string s);
+
+	/*! Writes \a s (\a n bytes) to \a out with every non-printable byte written as a \\x escape of two
+	 *  hex digits and every backslash doubled, so replaceEscapes() gives back the same bytes.
+	 *  \a out must have room for maxPrintableSize(n) bytes. Returns the end of the written bytes.
+	 *  Runs of bytes which need no escape are found by scanUnescaped() and copied at once. */
+	char *makeCharsPrintable(const char *s, size_t n, char *out);
+
+	/*! Appends \a s made printable, as by makeCharsPrintable(const char *, size_t, char *), to
+	 *  \a out, and returns the number of bytes appended. The bytes are escaped a chunk at a time
+	 *  through a buffer on the stack, so \a out only grows by what is written. \a s may point
+	 *  into \a out, but is then copied first. */
+	size_t makeCharsPrintable(string_view s, string &out);
+
+	/*! Returns \a s made printable, as by makeCharsPrintable(const char *, size_t, char *). */
+	string makeCharsPrintable(string_view s);
+
+	/*! Returns the largest number of bytes makeCharsPrintable() can write for \a n bytes. */
+	size_t maxPrintableSize(size_t n);
+
+	/*! Writes \a s (\a n bytes) to \a out with its C escape sequences replaced by the bytes they
+	 *  stand for: \\a \\b \\f \\n \\r \\t \\v \\' \\" \\? \\\\, \\x followed by up to two hex
+	 *  digits and \\ followed by up to three octal digits. A backslash before any other character
+	 *  is dropped together with it. The result is never longer than \a s, so \a out needs room for
+	 *  \a n bytes and may be \a s itself. Returns the end of the written bytes.
+	 *  Backslashes are found with memchr(), and the text between them copied at once. */
+	char *replaceEscapes(const char *s, size_t n, char *out);
+
+	/*! Appends \a s with its escape sequences replaced, as by
+	 *  replaceEscapes(const char *, size_t, char *), to \a out, and returns the number of bytes
+	 *  appended. \a s is appended as it is and its escapes replaced in place, so \a out grows at
+	 *  most once, by no more than the size of \a s, and \a s may point into \a out. */
+	size_t replaceEscapes(string_view s, string &out);
+
+	/*! Returns \a s with its escape sequences replaced, as by
+	 *  replaceEscapes(const char *, size_t, char *). */
+	string replaceEscapes(string_view s);
+
+	/*! Read-only memory map of a whole file, unmapped by the destructor. The file's bytes are read
+	 *  straight from the page cache, without being copied into the program's memory.
+	 *  \warning If the file can't be opened or mapped, an error is displayed and the map is empty
+	 *  (isOpen() returns false). */
+	class MappedFile
+	{
+	protected:
+		const char *addr;
+		size_t length;
+		bool open;
+
+	public:
+		/*! Constructor. Maps the file at \a path. */
+		MappedFile(const char *path);
+
+		/*! Destructor. */
+		~MappedFile();
+
+		MappedFile(const MappedFile &f) = delete;
+		MappedFile &operator = (const MappedFile &f) = delete;
+
+		/*! Returns true if the file was mapped. */
+		bool isOpen() const;
+
+		/*! Returns the file's bytes. */
+		const char *data() const;
+
+		/*! Returns the size of the file. */
+		size_t size() const;
+
+		/*! Returns the file's bytes as a string_view. */
+		string_view view() const;
+	};
 }
 
 #endif
\ No newline at end of file
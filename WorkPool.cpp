@@ -0,0 +1,127 @@
+#include "WorkPool.h"
+
+namespace unixescape
+{
+	WorkPool::WorkPool(size_t threads) : generation(0), busy(0), stopping(false)
+	{
+		if (threads == 0)
+			threads = std::thread::hardware_concurrency();
+		if (threads == 0)
+			threads = 1;
+
+		for (size_t i = 0; i < threads; i++)
+			queues.push_back(std::unique_ptr<Queue>(new Queue()));
+		for (size_t i = 1; i < threads; i++)
+			workers.push_back(std::thread(&WorkPool::loop, this, i));
+	}
+
+	WorkPool::~WorkPool()
+	{
+		{
+			std::lock_guard<std::mutex> l(lock);
+			stopping = true;
+		}
+		wake.notify_all();
+
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+	}
+
+	bool WorkPool::next(size_t self, size_t &task)
+	{
+		{
+			Queue &q = *queues[self];
+			std::lock_guard<std::mutex> l(q.lock);
+			if (!q.tasks.empty())
+			{
+				task = q.tasks.front();
+				q.tasks.pop_front();
+				return true;
+			}
+		}
+
+		// steal from the back, which is the work the owner will get to last
+		for (size_t i = 1; i < queues.size(); i++)
+		{
+			Queue &q = *queues[(self+i)%queues.size()];
+			std::lock_guard<std::mutex> l(q.lock);
+			if (!q.tasks.empty())
+			{
+				task = q.tasks.back();
+				q.tasks.pop_back();
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void WorkPool::work(size_t self)
+	{
+		size_t task;
+		while (next(self, task))
+			job(task);
+	}
+
+	void WorkPool::loop(size_t self)
+	{
+		size_t seen = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> l(lock);
+				wake.wait(l, [&]() { return (stopping || generation != seen); });
+				if (stopping)
+					return ;
+				seen = generation;
+			}
+
+			work(self);
+
+			{
+				std::lock_guard<std::mutex> l(lock);
+				busy--;
+			}
+			done.notify_all();
+		}
+	}
+
+	void WorkPool::runJob(size_t n, const std::function<void(size_t)> &f)
+	{
+		std::lock_guard<std::mutex> r(runLock);
+
+		// give every thread a contiguous share, so neighbouring tasks usually run on the same thread
+		size_t threads = queues.size();
+		for (size_t i = 0; i < threads; i++)
+		{
+			std::lock_guard<std::mutex> l(queues[i]->lock);
+			for (size_t t = n*i/threads; t < n*(i+1)/threads; t++)
+				queues[i]->tasks.push_back(t);
+		}
+
+		{
+			std::lock_guard<std::mutex> l(lock);
+			job = f;
+			busy = workers.size();
+			generation++;
+		}
+		wake.notify_all();
+
+		work(0);
+
+		std::unique_lock<std::mutex> l(lock);
+		done.wait(l, [&]() { return (busy == 0); });
+		job = nullptr;
+	}
+
+	size_t WorkPool::getThreadCount()
+	{
+		return queues.size();
+	}
+
+	WorkPool &WorkPool::shared()
+	{
+		static WorkPool pool;
+		return pool;
+	}
+}
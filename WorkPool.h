@@ -0,0 +1,91 @@
+/* Copyright 2013 Oliver Katz
+ *
+ * This file is part of LibUNIXEscape.
+ *
+ * LibUNIXEscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * LibUNIXEscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with LibUNIXEscape.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file WorkPool.h
+ *  \brief Contains WorkPool class, the thread pool used by the parallel parser.
+ *  Every call to WorkPool::run() splits a range of task indices between the threads. Each thread
+ *  works through its own share from the front and, once it runs out, steals tasks from the back
+ *  of the other threads' shares, so uneven tasks still keep every thread busy. */
+
+#ifndef __LIB_UNIX_ESCAPE_WORK_POOL_H
+#define __LIB_UNIX_ESCAPE_WORK_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*! Namespace for all LibUNIXEscape classes/methods/global variables. */
+namespace unixescape
+{
+	/*! Fixed-size pool of worker threads with work stealing. The thread calling run() takes part
+	 *  in the work, so a pool of n threads starts n-1 workers.
+	 *  \warning run() must not be called from inside a task of the same pool. */
+	class WorkPool
+	{
+	protected:
+		typedef struct Queue
+		{
+			std::mutex lock;
+			std::deque<size_t> tasks;
+		} Queue;
+
+		std::vector<std::thread> workers;
+		std::vector<std::unique_ptr<Queue> > queues;
+		std::mutex runLock;
+		std::mutex lock;
+		std::condition_variable wake;
+		std::condition_variable done;
+		std::function<void(size_t)> job;
+		size_t generation;
+		size_t busy;
+		bool stopping;
+
+		bool next(size_t self, size_t &task);
+		void work(size_t self);
+		void loop(size_t self);
+		void runJob(size_t n, const std::function<void(size_t)> &f);
+
+	public:
+		/*! Constructor. \a threads is the number of threads to use, including the caller of run();
+		 *  0 means one per hardware thread. */
+		WorkPool(size_t threads = 0);
+
+		/*! Destructor. Stops and joins the workers. */
+		~WorkPool();
+
+		/*! Returns the number of threads working on each run(), including the caller. */
+		size_t getThreadCount();
+
+		/*! Calls \a f(i) for every i from 0 to \a n-1 on the pool's threads, and returns once all
+		 *  the calls have finished. Calls from different threads are run one after the other. */
+		template<typename F> void run(size_t n, F f)
+		{
+			runJob(n, std::function<void(size_t)>(f));
+		}
+
+		/*! Returns a pool with one thread per hardware thread, created on first use. */
+		static WorkPool &shared();
+	};
+}
+
+#endif